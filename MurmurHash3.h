@@ -1,4 +1,5 @@
 #pragma once
+#include <string.h>
 #if defined(_MSC_VER) && (_MSC_VER < 1600)
 
 typedef unsigned char uint8_t;
@@ -126,6 +127,8 @@ static inline void MurmurHash3_x64_128 ( const void * key, const int len,
   h1 += h2;
   h2 += h1;
 
-  ((uint64_t*)out)[0] = h1;
-  ((uint64_t*)out)[1] = h2;
+  // out is usually an unsigned int[4]; copy bytes instead of storing through
+  // a uint64_t* so optimizing builds cannot drop the stores (strict aliasing)
+  memcpy(out, &h1, sizeof(h1));
+  memcpy((uint8_t*)out + sizeof(h1), &h2, sizeof(h2));
 }
\ No newline at end of file
@@ -0,0 +1,57 @@
+#include "arena.h"
+
+Arena::~Arena()
+{
+    for (auto block : blocks)
+        delete [] block;
+}
+
+// 函数返回值 char*: 没有对齐要求的 bytes 字节，用于 value
+char *Arena::Allocate(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (bytes <= remaining) {
+        char *result = ptr;
+        ptr += bytes;
+        remaining -= bytes;
+        return result;
+    }
+    return AllocateFallback(bytes);
+}
+
+// 函数返回值 char*: 按指针大小对齐的 bytes 字节，用于结点
+char *Arena::AllocateAligned(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t align = alignof(void *);
+    size_t slop = (align - (uintptr_t) ptr % align) % align;
+    if (bytes + slop <= remaining) {
+        char *result = ptr + slop;
+        ptr += bytes + slop;
+        remaining -= bytes + slop;
+        return result;
+    }
+    return AllocateFallback(bytes); // 新块的起始地址由 new 保证对齐
+}
+
+// 调用者持有 mutex，当前块放不下：大的分配单独成块，否则丢弃当前块的剩余部分，换一个新块
+char *Arena::AllocateFallback(size_t bytes)
+{
+    if (bytes > ARENA_BLOCK_SIZE / 4)
+        return AllocateBlock(bytes);
+
+    ptr = AllocateBlock(ARENA_BLOCK_SIZE);
+    remaining = ARENA_BLOCK_SIZE;
+    char *result = ptr;
+    ptr += bytes;
+    remaining -= bytes;
+    return result;
+}
+
+char *Arena::AllocateBlock(size_t bytes)
+{
+    char *block = new char [bytes];
+    blocks.push_back(block);
+    usage += bytes + sizeof(char *);
+    return block;
+}
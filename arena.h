@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <mutex>
+
+#define ARENA_BLOCK_SIZE 65536 // 每次向系统申请的块大小
+
+// 跳表结点的内存池：从大块内存中顺序切分，不单独释放，析构时整体归还
+// 超过块大小四分之一的分配单独占用一块，避免浪费当前块的剩余空间；并发的写者经由 mutex 分配，临界区只有指针的移动
+class Arena {
+private:
+    char *ptr; // 当前块中尚未分配的起始地址
+    size_t remaining; // 当前块剩余的字节数
+    std::vector<char *> blocks;
+    std::atomic<uint64_t> usage; // 已向系统申请的总字节数
+    std::mutex mutex;
+
+    char *AllocateFallback(size_t bytes);
+    char *AllocateBlock(size_t bytes);
+
+public:
+    Arena(): ptr(nullptr), remaining(0), usage(0) {}
+    ~Arena();
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    char *Allocate(size_t bytes);
+    char *AllocateAligned(size_t bytes);
+    uint64_t MemoryUsage() const {return usage;}
+};
@@ -0,0 +1,52 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+#include "../kvstore.h"
+
+// 以数据块大小 block_size 写入 n 个键值对，输出索引区每百万个键占用的内存以及查找的平均耗时
+static void run(uint32_t block_size, uint64_t n, uint64_t size, uint64_t m)
+{
+    Options options;
+    options.block_size = block_size;
+    KVStore store("./bench_data", options);
+    store.reset();
+
+    std::string val(size, 'v');
+    for (uint64_t i = 0; i < n; ++i)
+        store.put((i * 2654435761ULL) % n * 2, val); // 键均为偶数
+    store.Flush();
+
+    double memory = store.GetIndexMemory() * 1e6 / n;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i)
+        store.get((i * 40503ULL) % n * 2);
+    double hit = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i)
+        store.get((i * 40503ULL) % n * 2 + 1);
+    double miss = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "block size " << block_size << ": " << memory / 1024 << " KB index per million keys, "
+              << hit * 1e6 / m << " us/get (existing), " << miss * 1e6 / m << " us/get (missing)" << std::endl;
+    store.reset();
+}
+
+// 用法: block_bench [键值对个数] [value 字节数] [查找次数]
+// 数据块大小为 0 时是每个键都有索引项的格式
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 100;
+    uint64_t m = argc > 3 ? strtoull(argv[3], nullptr, 10) : 100000;
+
+    std::cout << "keys: " << n << ", value size: " << size << ", lookups: " << m << std::endl;
+    uint32_t sizes[] = {0, 1024, 4096, 16384};
+    for (uint32_t block_size : sizes)
+        run(block_size, n, size, m);
+    return 0;
+}
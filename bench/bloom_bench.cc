@@ -0,0 +1,102 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+#include "../bloom.h"
+
+typedef bool (*block_kernel)(const uint8_t *, uint64_t, uint32_t, uint32_t);
+
+static std::vector<uint8_t *> filters;
+static std::vector<uint64_t> hashes; // 每次查找的两个哈希值，预先算好，只计探测的开销
+static uint32_t bytes;
+static volatile uint64_t sink;
+
+// 输出每次查找的平均耗时与误判率，所有查找的键都不在 Bloom Filter 中
+static void report(const char *name, uint64_t m, uint64_t hits, double seconds)
+{
+    std::cout << name << ": " << seconds * 1e9 / m << " ns/lookup, false positive rate "
+              << 100.0 * hits / m << "%" << std::endl;
+}
+
+static void run_standard(uint64_t m, uint32_t probes)
+{
+    uint64_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i)
+        hits += BloomFilter::MayContain(filters[i % filters.size()], bytes, probes, &hashes[2 * i]);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = hits;
+    report("standard", m, hits, seconds);
+}
+
+// 直接调用某个块内核，块的选取与 BlockedMayContain 相同
+static void run_blocked(const char *name, block_kernel kernel, uint64_t m, uint32_t probes)
+{
+    uint64_t blocks = bytes / BLOOM_BLOCK_BYTES;
+    uint64_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i) {
+        const uint8_t *block = filters[i % filters.size()] + ((hashes[2 * i] >> 32) * blocks >> 32) * BLOOM_BLOCK_BYTES;
+        hits += kernel(block, hashes[2 * i + 1], hashes[2 * i] & (BLOOM_BLOCK_PROBES - 1), probes);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = hits;
+    report(name, m, hits, seconds);
+}
+
+// 用法: bloom_bench [每个 Bloom Filter 的键数] [Bloom Filter 个数] [查找次数] [每个键的比特数]
+// 先后用双重哈希与分块两种布局构造同样多的 Bloom Filter，轮流在各个 Bloom Filter 中查找不存在的键
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 8000;
+    uint64_t tables = argc > 2 ? strtoull(argv[2], nullptr, 10) : 256;
+    uint64_t m = argc > 3 ? strtoull(argv[3], nullptr, 10) : 10000000;
+    int bits_per_key = argc > 4 ? atoi(argv[4]) : 10;
+
+    std::cout << "keys per filter: " << n << ", filters: " << tables << ", lookups: " << m
+              << ", bits per key: " << bits_per_key << ", kernel: " << BloomFilter::KernelName() << std::endl;
+
+    // 键均为偶数，查找的键均为奇数
+    hashes.resize(2 * m);
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i)
+        BloomFilter::Hash((i * 2654435761ULL) % (n * tables) * 2 + 1, &hashes[2 * i]);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "hash: " << seconds * 1e9 / m << " ns/key" << std::endl;
+
+    uint64_t hash[2];
+    uint32_t probes = BloomFilter::Probes(bits_per_key);
+    bytes = BloomFilter::Bytes(n, bits_per_key);
+    for (uint64_t t = 0; t < tables; ++t) {
+        filters.push_back(BloomFilter::Allocate(bytes));
+        for (uint64_t i = 0; i < n; ++i) {
+            BloomFilter::Hash((i * tables + t) * 2, hash);
+            BloomFilter::Add(filters.back(), bytes, probes, hash);
+        }
+    }
+    run_standard(m, probes);
+    for (auto filter : filters)
+        BloomFilter::Release(filter);
+    filters.clear();
+
+    probes = BloomFilter::BlockedProbes(bits_per_key);
+    bytes = BloomFilter::BlockedBytes(n, bits_per_key);
+    for (uint64_t t = 0; t < tables; ++t) {
+        filters.push_back(BloomFilter::Allocate(bytes));
+        for (uint64_t i = 0; i < n; ++i) {
+            BloomFilter::Hash((i * tables + t) * 2, hash);
+            BloomFilter::BlockedAdd(filters.back(), bytes, probes, hash);
+        }
+    }
+    run_blocked("blocked scalar", BloomFilter::BlockScalar, m, probes);
+    if (BloomFilter::HasSSE2())
+        run_blocked("blocked sse2", BloomFilter::BlockSSE2, m, probes);
+    if (BloomFilter::HasAVX2())
+        run_blocked("blocked avx2", BloomFilter::BlockAVX2, m, probes);
+    for (auto filter : filters)
+        BloomFilter::Release(filter);
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+#include "../kvstore.h"
+
+// 用法: compaction_bench [键值对个数] [value 字节数] [键的间隔]
+// 键的间隔取得很大时（例如 2^40），键值覆盖区间远大于键值对个数，用以验证 compaction 的内存占用与区间无关
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 256;
+    uint64_t stride = argc > 3 ? strtoull(argv[3], nullptr, 10) : (1ULL << 40) / n;
+
+    KVStore store("./bench_data");
+    store.reset();
+
+    std::string val(size, 'v');
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < n; ++i) {
+        // 乱序写入，使各层文件之间产生重叠
+        uint64_t key = ((i * 2654435761ULL) % n) * stride;
+        store.put(key, val);
+    }
+    store.Flush(); // 等待后台的落盘与 compaction 全部完成
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CompactionStats stats = store.GetCompactionStats();
+    double seconds = stats.micros / 1e6;
+    double mb_read = stats.bytes_read / (1024.0 * 1024.0);
+    double mb_written = stats.bytes_written / (1024.0 * 1024.0);
+
+    std::cout << "keys: " << n << ", value size: " << size << ", key stride: " << stride << std::endl;
+    std::cout << "total put time: " << total << " s" << std::endl;
+    std::cout << "compactions: " << stats.count << std::endl;
+    std::cout << "compaction time: " << seconds << " s" << std::endl;
+    std::cout << "compaction read: " << mb_read << " MB, written: " << mb_written << " MB" << std::endl;
+    std::cout << "entries dropped: " << stats.entries_dropped << " shadowed, " << stats.tombstones_dropped << " tombstones" << std::endl;
+    if (seconds > 0)
+        std::cout << "compaction throughput: " << (mb_read + mb_written) / seconds << " MB/s" << std::endl;
+
+    store.reset();
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <sys/stat.h>
+
+#include "../kvstore.h"
+#include "../compress.h"
+#include "../utils.h"
+
+// 数据目录下各层 sst 文件的总字节数
+static uint64_t disk_bytes(const std::string &dir)
+{
+    uint64_t total = 0;
+    for (int level = 0; utils::dirExists(dir + "/level" + std::to_string(level)); ++level) {
+        std::string path = dir + "/level" + std::to_string(level);
+        std::vector<std::string> names;
+        utils::scanDir(path, names);
+        for (auto &name : names) {
+            struct stat st;
+            if (stat((path + "/" + name).c_str(), &st) == 0)
+                total += st.st_size;
+        }
+    }
+    return total;
+}
+
+// 两种 value：persistence 测试那样的单一字符长串，以及由少量单词随机拼成的文本
+static std::string make_value(bool text, uint64_t i, uint64_t size)
+{
+    if (!text)
+        return std::string(size, (char) ('s' + i % 6));
+    static const char *words[] = {"lsm ", "tree ", "level ", "compaction ", "bloom ", "filter ", "block ", "key ", "value ", "table "};
+    std::string val;
+    uint64_t seed = i + 1;
+    while (val.length() < size) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        val += words[(seed >> 33) % 10];
+    }
+    val.resize(size);
+    return val;
+}
+
+static void run(CompressionType type, bool text, uint64_t n, uint64_t size, uint64_t m)
+{
+    Options options;
+    options.compression = type;
+    KVStore store("./bench_data", options);
+    store.reset();
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < n; ++i)
+        store.put((i * 2654435761ULL) % n, make_value(text, i, size));
+    store.Flush();
+    double put = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CompactionStats stats = store.GetCompactionStats();
+    double mb = n * size / (1024.0 * 1024.0);
+
+    // 顺序扫描全部数据
+    start = std::chrono::steady_clock::now();
+    uint64_t bytes = 0;
+    Iterator *iter = store.NewIterator();
+    for (; iter->Valid(); iter->Next())
+        bytes += iter->value().length();
+    delete iter;
+    double scan = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // 随机读
+    start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i)
+        bytes += store.get((i * 40503ULL) % n).length();
+    double get = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << Compressor::Name(type) << (text ? ", text" : ", repeated") << ": "
+              << disk_bytes("./bench_data") / (1024.0 * 1024.0) << " MB on disk, "
+              << stats.bytes_written / (1024.0 * 1024.0) << " MB written by compaction, "
+              << mb / put << " MB/s put, " << mb / scan << " MB/s scan, "
+              << m * size / (1024.0 * 1024.0) / get << " MB/s get" << std::endl;
+    store.reset();
+}
+
+// 用法: compression_bench [键值对个数] [value 字节数] [随机读次数]
+// 对每种可用的压缩方式分别写入两种 value，输出磁盘占用、compaction 写出的字节数以及读写吞吐量
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 100000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000;
+    uint64_t m = argc > 3 ? strtoull(argv[3], nullptr, 10) : 50000;
+
+    std::cout << "keys: " << n << ", value size: " << size << ", lookups: " << m << std::endl;
+    CompressionType types[] = {NO_COMPRESSION, LZ_COMPRESSION, ZLIB_COMPRESSION};
+    for (auto type : types) {
+        if (!Compressor::Supported(type))
+            continue;
+        run(type, false, n, size, m);
+        run(type, true, n, size, m);
+    }
+    return 0;
+}
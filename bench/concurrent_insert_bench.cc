@@ -0,0 +1,101 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include "../kvstore.h"
+
+// 多个线程向同一个跳表插入互不相同的键，重复 rounds 次，每次使用新的跳表
+static double BenchSkipList(int threads, const std::vector<uint64_t> &keys, int rounds, const std::string &val)
+{
+    double seconds = 0;
+    for (int r = 0; r < rounds; ++r) {
+        SkipList list;
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&list, &keys, &val, t, threads]() {
+                for (size_t i = t; i < keys.size(); i += threads)
+                    list.Insert(keys[i], val);
+            });
+        }
+        for (auto &worker : workers)
+            worker.join();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (list.GetCount() != (int) keys.size()) {
+            std::cerr << "lost inserts: " << list.GetCount() << " of " << keys.size() << std::endl;
+            exit(1);
+        }
+    }
+    return keys.size() * rounds / seconds;
+}
+
+// 多个线程通过 KVStore::put 写入互不相同的键，包括 WAL 与后台落盘
+static double BenchStore(int threads, const std::vector<uint64_t> &keys, int rounds, const std::string &val, bool use_wal)
+{
+    Options options;
+    options.use_wal = use_wal;
+    KVStore store("./bench_data", options);
+    store.reset();
+
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&store, &keys, &val, t, threads, r]() {
+                for (size_t i = t; i < keys.size(); i += threads)
+                    store.put(keys[i] + r * keys.size(), val);
+            });
+        }
+        for (auto &worker : workers)
+            worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    store.reset();
+    return keys.size() * rounds / seconds;
+}
+
+// 用法: concurrent_insert_bench [每轮键值对个数] [value 字节数] [最大线程数] [轮数]
+// 从 1 个线程到最大线程数，分别衡量直接插入跳表与经由 put 写入（不开启与开启 WAL）的吞吐量及相对单线程的加速比
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 50000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 16;
+    int max_threads = argc > 3 ? atoi(argv[3]) : (int) std::max(1u, std::thread::hardware_concurrency());
+    int rounds = argc > 4 ? atoi(argv[4]) : 10;
+
+    std::vector<uint64_t> keys(n);
+    for (uint64_t i = 0; i < n; ++i)
+        keys[i] = i;
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+    std::string val(size, 'v');
+
+    std::cout << "keys per round: " << n << ", value size: " << size << ", rounds: " << rounds
+              << ", hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+    double base[3] = {0, 0, 0};
+    for (int threads = 1; threads <= max_threads; threads *= 2) {
+        double rates[3] = {
+            BenchSkipList(threads, keys, rounds, val),
+            BenchStore(threads, keys, rounds, val, false),
+            BenchStore(threads, keys, rounds, val, true)
+        };
+        if (threads == 1)
+            std::copy(rates, rates + 3, base);
+
+        const char *names[3] = {"skiplist insert", "put without wal", "put with wal"};
+        std::cout << threads << " threads:" << std::endl;
+        for (int i = 0; i < 3; ++i)
+            std::cout << "  " << names[i] << ": " << (uint64_t) rates[i] << " ops/s (" << rates[i] / base[i] << "x)" << std::endl;
+
+        if (threads < max_threads && threads * 2 > max_threads)
+            threads = max_threads / 2; // 最后一次总是使用最大线程数
+    }
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+#include "../kvstore.h"
+
+// 输出一组查找的平均开销：每次 get 检查 Bloom Filter 与二分查找的次数，以及逐个遍历全部文件时需要检查的文件数
+static void report(const char *name, const ReadStats &before, const ReadStats &after, double seconds)
+{
+    double gets = after.gets - before.gets;
+    if (gets == 0)
+        return;
+    std::cout << name << ": " << (after.bloom_probes - before.bloom_probes) / gets << " bloom probes/get, "
+              << (after.index_searches - before.index_searches) / gets << " index searches/get, "
+              << (after.tables - before.tables) / gets << " tables a full walk would probe, "
+              << seconds * 1e6 / gets << " us/get" << std::endl;
+}
+
+// 用法: get_bench [键值对个数] [value 字节数] [查找次数] [Bloom Filter 每个键的比特数]
+// 数据全部落盘之后，分别查找存在的键与不存在的键，后者每次二分查找都来自 Bloom Filter 的误判
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 200000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 256;
+    uint64_t m = argc > 3 ? strtoull(argv[3], nullptr, 10) : 100000;
+
+    Options options;
+    if (argc > 4)
+        options.bloom_bits_per_key = atoi(argv[4]);
+
+    KVStore store("./bench_data", options);
+    store.reset();
+
+    std::string val(size, 'v');
+    for (uint64_t i = 0; i < n; ++i)
+        store.put((i * 2654435761ULL) % n * 2, val); // 键均为偶数
+    store.Flush();
+
+    std::cout << "keys: " << n << ", value size: " << size << ", lookups: " << m
+              << ", bloom bits per key: " << options.bloom_bits_per_key << std::endl;
+
+    ReadStats before = store.GetReadStats();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i)
+        store.get((i * 40503ULL) % n * 2);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ReadStats after = store.GetReadStats();
+    report("existing keys", before, after, seconds);
+
+    before = after;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i)
+        store.get((i * 40503ULL) % n * 2 + 1);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    after = store.GetReadStats();
+    report("missing keys", before, after, seconds);
+
+    store.reset();
+    return 0;
+}
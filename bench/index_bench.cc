@@ -0,0 +1,60 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+#include "../sstable.h"
+#include "../elias_fano.h"
+
+static volatile uint64_t sink;
+
+// 用法: index_bench [键的个数] [相邻键的平均间距] [查找次数]
+// 随机生成升序的键，比较原始数组上的 binarySearch 与 Elias-Fano 编码上的 LowerBound：每个键的字节数与每次查找的耗时
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    uint64_t gap = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000;
+    uint64_t m = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1000000;
+
+    std::vector<uint64_t> keys(n);
+    uint64_t key = 0, seed = 1;
+    for (uint64_t i = 0; i < n; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        key += 1 + (seed >> 33) % (2 * gap);
+        keys[i] = key;
+    }
+
+    // 一半查找存在的键，一半查找随机的键
+    std::vector<uint64_t> targets(m);
+    for (uint64_t i = 0; i < m; ++i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        targets[i] = i % 2 == 0 ? keys[(seed >> 20) % n] : (seed >> 11) % (key + 1);
+    }
+
+    EliasFano ef;
+    ef.Build(keys.data(), n);
+
+    std::cout << "keys: " << n << ", average gap: " << gap << ", lookups: " << m << std::endl;
+    std::cout << "raw array: " << 8.0 << " bytes/key, elias-fano: " << (double) ef.EncodedBytes() / n
+              << " bytes/key on disk, " << (double) ef.MemoryBytes() / n << " bytes/key in memory" << std::endl;
+
+    uint64_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i)
+        found += binarySearch(keys.data(), n, targets[i]) != SST_NOT_FOUND;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = found;
+    std::cout << "binarySearch: " << seconds * 1e9 / m << " ns/lookup, " << found << " found" << std::endl;
+
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i) {
+        uint64_t index = ef.LowerBound(targets[i]);
+        found += index < n && ef.Get(index) == targets[i];
+    }
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    sink = found;
+    std::cout << "elias-fano: " << seconds * 1e9 / m << " ns/lookup, " << found << " found" << std::endl;
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+
+#include "../kvstore.h"
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 直接用 SSTableWriter 生成 files 个互不重叠的 sst 文件，按每层的容量从 level1 开始填满（不会触发 compaction），再写入 MANIFEST
+static void build(const std::string &dir, uint64_t files, uint64_t keys, uint64_t size)
+{
+    {
+        KVStore store(dir);
+        store.reset();
+    }
+
+    Version version;
+    std::string val(size, 'v');
+    utils::mkdir((dir + "/level0").c_str());
+    int level = 1;
+    uint64_t in_level = 0;
+    for (uint64_t f = 0; f < files; ++f) {
+        if (in_level == (1ULL << (level + 1))) {
+            level ++ ;
+            in_level = 0;
+        }
+        std::string level_dir = dir + "/level" + std::to_string(level);
+        utils::mkdir(level_dir.c_str());
+
+        SSTableWriter writer(f + 1, Options());
+        for (uint64_t i = 0; i < keys; ++i)
+            writer.Add(f * keys + i, val);
+        sst_buf *add = writer.Finish(level_dir + "/level" + std::to_string(level) + "_" + std::to_string(f) + "_" + std::to_string(f) + ".sst");
+        if (add == nullptr) {
+            std::cout << "failed to write " << level_dir << std::endl;
+            exit(1);
+        }
+        add->level = level;
+        version.Add(add);
+        in_level ++ ;
+    }
+
+    Manifest manifest(dir);
+    manifest.WriteSnapshot(version, files, files);
+}
+
+// 打开数据库，并依次查找每个文件中的一个键，使所有文件的 Bloom Filter 与索引区都被用到
+static void measure(const char *name, const std::string &dir, uint64_t files, uint64_t keys, int prefetch_threads, bool wait_prefetch)
+{
+    Options options;
+    options.prefetch_threads = prefetch_threads;
+
+    double open, ready, lookups;
+    uint64_t found = 0;
+    {
+        auto start = std::chrono::steady_clock::now();
+        KVStore store(dir, options);
+        open = seconds_since(start);
+        if (wait_prefetch)
+            store.Flush(); // 等待后台预读全部完成
+        ready = seconds_since(start);
+
+        start = std::chrono::steady_clock::now();
+        for (uint64_t f = 0; f < files; ++f)
+            found += !store.get(f * keys).empty();
+        lookups = seconds_since(start);
+    }
+
+    std::cout << name << ": open " << open * 1000 << " ms";
+    if (wait_prefetch)
+        std::cout << ", all tables loaded after " << ready * 1000 << " ms";
+    std::cout << ", first get on every table " << lookups * 1000 << " ms (" << found << "/" << files << " found)" << std::endl;
+}
+
+// 用法: open_bench [sst 文件个数] [每个文件的键值对个数] [value 字节数]
+// 文件刚刚写出，测得的是页缓存命中时的打开时间
+int main(int argc, char *argv[])
+{
+    uint64_t files = argc > 1 ? strtoull(argv[1], nullptr, 10) : 4000;
+    uint64_t keys = argc > 2 ? strtoull(argv[2], nullptr, 10) : 1000;
+    uint64_t size = argc > 3 ? strtoull(argv[3], nullptr, 10) : 16;
+    std::string dir = "./bench_data";
+
+    std::cout << "tables: " << files << ", keys per table: " << keys << ", value size: " << size << std::endl;
+    build(dir, files, keys, size);
+
+    measure("lazy (no prefetch)", dir, files, keys, 0, false);
+    measure("lazy + 4 prefetch threads", dir, files, keys, 4, false);
+    measure("lazy + 4 prefetch threads", dir, files, keys, 4, true);
+
+    // 删除 MANIFEST 后退回到逐个读入全部文件的旧方式
+    utils::rmfile((dir + "/MANIFEST").c_str());
+    measure("directory scan, eager load", dir, files, keys, 0, false);
+
+    KVStore store(dir);
+    store.reset();
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <list>
+#include <chrono>
+
+#include "../kvstore.h"
+
+static double since(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// 用法: range_delete_bench [键值对个数] [value 字节数]
+// 数据全部落盘之后，对每种区间宽度 w 分别用逐键 del 删除 w 个相邻的键，用一次 delete_range 删除另外 w 个相邻的键，
+// 比较两者的写入耗时，并用 scan 确认两段都已清空
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 250000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 100;
+
+    KVStore store("./bench_data");
+    store.reset();
+
+    std::string val(size, 'v');
+    for (uint64_t i = 0; i < n; ++i)
+        store.put(i, val);
+    store.Flush();
+
+    std::cout << "keys: " << n << ", value size: " << size << std::endl;
+    uint64_t widths[] = {1000, 10000, 100000};
+    uint64_t base = 0;
+    for (uint64_t w : widths) {
+        if (base + 2 * w > n)
+            break;
+
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t key = base; key < base + w; ++key)
+            store.del(key);
+        double loop = since(start);
+
+        start = std::chrono::steady_clock::now();
+        store.delete_range(base + w, base + 2 * w - 1);
+        double range = since(start);
+
+        std::list<std::pair<uint64_t, std::string> > list;
+        store.scan(base, base + 2 * w - 1, list);
+        std::cout << "width " << w << ": del loop " << loop * 1e3 << " ms (" << loop * 1e6 / w << " us/key), delete_range "
+                  << range * 1e6 << " us, " << list.size() << " keys left" << std::endl;
+        base += 2 * w;
+    }
+
+    store.reset();
+    return 0;
+}
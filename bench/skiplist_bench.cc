@@ -0,0 +1,173 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <new>
+#include <malloc.h>
+
+#include "../skiplist.h"
+
+// 统计堆上仍在使用的字节数（按分配器实际给出的大小）与分配次数
+static uint64_t heap_bytes = 0;
+static uint64_t heap_allocs = 0;
+
+__attribute__((noinline)) void *operator new(size_t size)
+{
+    void *p = malloc(size);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    heap_bytes += malloc_usable_size(p);
+    heap_allocs ++;
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void *ptr) noexcept
+{
+    if (ptr == nullptr)
+        return;
+    heap_bytes -= malloc_usable_size(ptr);
+    free(ptr);
+}
+
+void *operator new[](size_t size) {return operator new(size);}
+void operator delete[](void *ptr) noexcept {operator delete(ptr);}
+void operator delete(void *ptr, size_t) noexcept {operator delete(ptr);}
+void operator delete[](void *ptr, size_t) noexcept {operator delete(ptr);}
+
+// 改为内存池之前的跳表结点：每个结点单独分配，带 MAX_LEVEL 个指针的 vector 与单独的 value 字符串
+struct LegacyNode
+{
+    uint64_t key;
+    std::string val;
+    SKNodeType type;
+    ValueType value_type;
+    uint64_t seq;
+    std::vector<LegacyNode *> forwards;
+    LegacyNode(uint64_t _key, std::string _val, SKNodeType _type)
+            : key(_key), val(_val), type(_type), value_type(TYPE_VALUE), seq(0)
+    {
+        for (int i = 0; i < MAX_LEVEL; ++i)
+            forwards.push_back(nullptr);
+    }
+};
+
+class LegacySkipList
+{
+private:
+    unsigned long long s = 1;
+    uint64_t last_seq = 0;
+    LegacyNode *head;
+    LegacyNode *NIL;
+
+    double my_rand()
+    {
+        s = (16807 * s) % 2147483647ULL;
+        return (s + 0.0) / 2147483647ULL;
+    }
+
+    int randomLevel()
+    {
+        int result = 1;
+        while (result < MAX_LEVEL && my_rand() < 0.5)
+            ++result;
+        return result;
+    }
+
+public:
+    LegacySkipList()
+    {
+        head = new LegacyNode(0, "", HEAD);
+        NIL = new LegacyNode(ULONG_LONG_MAX, "", SKNodeType::NIL);
+        for (int i = 0; i < MAX_LEVEL; ++i)
+            head->forwards[i] = NIL;
+    }
+
+    ~LegacySkipList()
+    {
+        LegacyNode *n1 = head;
+        while (n1) {
+            LegacyNode *n2 = n1->forwards[0];
+            delete n1;
+            n1 = n2;
+        }
+    }
+
+    void Insert(uint64_t key, std::string value)
+    {
+        LegacyNode *travel = head;
+        LegacyNode *update[MAX_LEVEL];
+        for (int i = 0; i < MAX_LEVEL; ++i)
+            update[i] = head;
+        for (int level = MAX_LEVEL - 1; level >= 0; level--) {
+            while (travel->forwards[level] != NIL && travel->forwards[level]->key < key) {
+                travel = travel->forwards[level];
+                for (int i = level; i >= 0; --i)
+                    update[i] = travel;
+            }
+        }
+
+        if (travel->forwards[0]->key == key) {
+            travel->forwards[0]->val = value;
+            travel->forwards[0]->seq = ++last_seq;
+            return;
+        }
+
+        int new_level = randomLevel();
+        auto *new_node = new LegacyNode(key, value, NORMAL);
+        new_node->seq = ++last_seq;
+        for (int i = 0; i < new_level; ++i) {
+            new_node->forwards[i] = update[i]->forwards[i];
+            update[i]->forwards[i] = new_node;
+        }
+    }
+};
+
+template <class List>
+static void Run(const char *name, const std::vector<uint64_t> &keys, const std::string &val)
+{
+    uint64_t bytes = heap_bytes, allocs = heap_allocs;
+    auto start = std::chrono::steady_clock::now();
+    auto *list = new List();
+    for (uint64_t key : keys)
+        list->Insert(key, val);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t used = heap_bytes - bytes, count = heap_allocs - allocs;
+
+    start = std::chrono::steady_clock::now();
+    delete list;
+    double release = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "  " << name << ": " << (uint64_t) (keys.size() / seconds) << " inserts/s, "
+              << (double) used / keys.size() << " bytes/entry, " << (double) count / keys.size() << " allocations/entry, "
+              << "release " << release * 1e3 << " ms" << std::endl;
+}
+
+// 用法: skiplist_bench [键值对个数] [value 字节数]
+// 以随机顺序插入互不相同的键（默认个数约为一个写满的 MemTable），分别对 16 字节与给定大小的 value 比较两种结点布局的插入吞吐、
+// 每个键值对占用的堆内存与分配次数，以及释放整个跳表的耗时
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 50000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 100;
+
+    std::vector<uint64_t> keys(n);
+    for (uint64_t i = 0; i < n; ++i)
+        keys[i] = i;
+    std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+
+    std::cout << "keys: " << n << std::endl;
+    uint64_t sizes[] = {16, size};
+    for (uint64_t s : sizes) {
+        std::string val(s, 'v');
+        std::cout << "value size " << s << ":" << std::endl;
+        Run<LegacySkipList>("vector + string nodes", keys, val);
+        Run<SkipList>("arena nodes          ", keys, val);
+        if (s == size)
+            break;
+    }
+    return 0;
+}
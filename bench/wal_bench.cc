@@ -0,0 +1,90 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../kvstore.h"
+
+static const char *ModeName(WALSyncMode mode)
+{
+    switch (mode) {
+        case SYNC_EVERY_WRITE: return "every-write";
+        case SYNC_GROUP_COMMIT: return "group-commit";
+        default: return "periodic";
+    }
+}
+
+// 多个线程并发向同一个 WAL 追加记录，衡量各刷盘策略下的吞吐量
+static void BenchLog(WALSyncMode mode, int threads, uint64_t n, const std::string &val)
+{
+    std::string path = "./bench_data/bench.log";
+    utils::rmfile(path.c_str());
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        WriteAheadLog log(path, mode, 100);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&log, t, n, &val]() {
+                for (uint64_t i = 0; i < n; ++i)
+                    log.Append(t * n + i, val);
+            });
+        }
+        for (auto &worker : workers)
+            worker.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    utils::rmfile(path.c_str());
+
+    std::cout << "  wal " << ModeName(mode) << ", " << threads << " threads: "
+              << (uint64_t) (threads * n / seconds) << " appends/s" << std::endl;
+}
+
+// 单线程通过 KVStore::put 写入，衡量 WAL 对前台写入的开销
+static void BenchStore(bool use_wal, WALSyncMode mode, uint64_t n, const std::string &val)
+{
+    Options options;
+    options.use_wal = use_wal;
+    options.wal_sync = mode;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        KVStore store("./bench_data", options);
+        store.reset();
+        for (uint64_t i = 0; i < n; ++i)
+            store.put(i, val);
+        store.reset();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "  put " << (use_wal ? ModeName(mode) : "no-wal") << ": "
+              << (uint64_t) (n / seconds) << " puts/s" << std::endl;
+}
+
+// 用法: wal_bench [每个线程的写入次数] [value 字节数] [最大线程数]
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 100;
+    int max_threads = argc > 3 ? atoi(argv[3]) : 8;
+
+    utils::mkdir("./bench_data");
+    std::string val(size, 'v');
+    WALSyncMode modes[] = {SYNC_EVERY_WRITE, SYNC_GROUP_COMMIT, SYNC_PERIODIC};
+
+    std::cout << "WriteAheadLog::Append, " << n << " appends per thread, value size " << size << std::endl;
+    for (auto mode : modes) {
+        for (int threads = 1; threads <= max_threads; threads *= 2)
+            BenchLog(mode, threads, n, val);
+    }
+
+    std::cout << "KVStore::put, " << n << " puts, value size " << size << std::endl;
+    BenchStore(false, SYNC_PERIODIC, n, val);
+    for (auto mode : modes)
+        BenchStore(true, mode, n, val);
+
+    return 0;
+}
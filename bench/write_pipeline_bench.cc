@@ -0,0 +1,102 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "../kvstore.h"
+
+static const char *ModeName(WALSyncMode mode)
+{
+    switch (mode) {
+        case SYNC_EVERY_WRITE: return "every-write";
+        case SYNC_GROUP_COMMIT: return "group-commit";
+        default: return "periodic";
+    }
+}
+
+// 多个客户端线程各自通过 KVStore::put 写入互不相同的小键值对，衡量写队列的吞吐量与平均组大小
+static void BenchPut(WALSyncMode mode, int threads, uint64_t n, const std::string &val)
+{
+    Options options;
+    options.wal_sync = mode;
+    KVStore store("./bench_data", options);
+    store.reset();
+    WriteStats before = store.GetWriteStats();
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&store, &val, t, n]() {
+            for (uint64_t i = 0; i < n; ++i)
+                store.put(t * n + i, val);
+        });
+    }
+    for (auto &worker : workers)
+        worker.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    WriteStats after = store.GetWriteStats();
+    store.reset();
+
+    uint64_t groups = std::max<uint64_t>(1, after.groups - before.groups);
+    std::cout << "  " << threads << " threads: " << (uint64_t) (threads * n / seconds) << " puts/s, "
+              << (double) (after.writers - before.writers) / groups << " writers per group" << std::endl;
+}
+
+// 单线程以每批 batch_size 个 put 经由 KVStore::write 写入，batch_size 为 1 时即逐个 put
+static void BenchBatch(WALSyncMode mode, int batch_size, uint64_t n, const std::string &val)
+{
+    Options options;
+    options.wal_sync = mode;
+    KVStore store("./bench_data", options);
+    store.reset();
+
+    auto start = std::chrono::steady_clock::now();
+    WriteBatch batch;
+    for (uint64_t i = 0; i < n; ++i) {
+        batch.Put(i, val);
+        if (batch.Count() == batch_size || i + 1 == n) {
+            store.write(batch);
+            batch.Clear();
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    store.reset();
+
+    std::cout << "  batch size " << batch_size << ": " << (uint64_t) (n / seconds) << " puts/s" << std::endl;
+}
+
+// 用法: write_pipeline_bench [每个线程的写入次数] [value 字节数] [最大线程数]
+// 对每种刷盘策略，从 1 个线程到最大线程数衡量小写入的吞吐量；同一组的写入只追加一条 WAL 记录、刷盘一次
+// 再由单个线程分别以 1、16、256 个 put 为一批写入同样多的键值对
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 2000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 16;
+    int max_threads = argc > 3 ? atoi(argv[3]) : 16;
+
+    std::string val(size, 'v');
+    WALSyncMode modes[] = {SYNC_EVERY_WRITE, SYNC_GROUP_COMMIT, SYNC_PERIODIC};
+
+    std::cout << "put, " << n << " puts per thread, value size " << size
+              << ", hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    for (auto mode : modes) {
+        std::cout << "wal " << ModeName(mode) << ":" << std::endl;
+        for (int threads = 1; threads <= max_threads; threads *= 2) {
+            BenchPut(mode, threads, n, val);
+            if (threads < max_threads && threads * 2 > max_threads)
+                threads = max_threads / 2; // 最后一次总是使用最大线程数
+        }
+    }
+
+    std::cout << "write(batch), " << n * max_threads << " puts, value size " << size << std::endl;
+    for (auto mode : modes) {
+        std::cout << "wal " << ModeName(mode) << ":" << std::endl;
+        for (int batch_size : {1, 16, 256})
+            BenchBatch(mode, batch_size, n * max_threads, val);
+    }
+    return 0;
+}
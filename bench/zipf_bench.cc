@@ -0,0 +1,108 @@
+#include <iostream>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+
+#include "../kvstore.h"
+
+// 按 Zipf 分布生成 [0, n) 中的排名，排名 0 最热（Gray 等人的方法，与 YCSB 相同），theta 越大越集中
+class Zipfian {
+private:
+    uint64_t n;
+    double theta, alpha, zeta_n, eta;
+    uint64_t state;
+
+    double Next01() {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (state >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+public:
+    Zipfian(uint64_t n, double theta): n(n), theta(theta), state(1) {
+        double zeta_2 = 1 + pow(0.5, theta);
+        zeta_n = 0;
+        for (uint64_t i = 1; i <= n; ++i)
+            zeta_n += 1 / pow((double) i, theta);
+        alpha = 1 / (1 - theta);
+        eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta_2 / zeta_n);
+    }
+
+    uint64_t Next() {
+        double u = Next01();
+        double uz = u * zeta_n;
+        if (uz < 1)
+            return 0;
+        if (uz < 1 + pow(0.5, theta))
+            return 1;
+        return std::min(n - 1, (uint64_t) (n * pow(eta * u - eta + 1, alpha)));
+    }
+};
+
+// 热点键分散在整个键空间中，而不是集中在相邻的几个数据块里
+static uint64_t scramble(uint64_t rank, uint64_t n)
+{
+    uint64_t x = rank * 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 29;
+    return x % n;
+}
+
+// 以行缓存容量 row_cache_size 重新打开数据库，按 Zipf 分布查找 m 次，输出平均、中位数与 99 分位的耗时以及行缓存命中率
+static void run(uint64_t row_cache_size, uint64_t n, uint64_t m, double theta)
+{
+    Options options;
+    options.row_cache_size = row_cache_size;
+    KVStore store("./bench_data", options);
+
+    Zipfian zipf(n, theta);
+    for (uint64_t i = 0; i < m / 10; ++i) // 预热
+        store.get(scramble(zipf.Next(), n));
+    ReadStats before = store.GetReadStats();
+
+    std::vector<double> latency(m);
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < m; ++i) {
+        uint64_t key = scramble(zipf.Next(), n);
+        auto t = std::chrono::steady_clock::now();
+        store.get(key);
+        latency[i] = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t).count();
+    }
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    ReadStats after = store.GetReadStats();
+
+    std::sort(latency.begin(), latency.end());
+    uint64_t hits = after.row_cache_hits - before.row_cache_hits;
+    std::cout << "row cache " << row_cache_size / (1024 * 1024) << " MB: " << total * 1e6 / m << " us/get, p50 "
+              << latency[m / 2] << " us, p99 " << latency[m * 99 / 100] << " us, row cache hit rate "
+              << 100.0 * hits / m << "%" << std::endl;
+}
+
+// 用法: zipf_bench [键值对个数] [value 字节数] [查找次数] [theta]
+// 数据全部落盘之后再查找，跳表为空，每次 get 都需要访问 SSTable（或行缓存）
+int main(int argc, char *argv[])
+{
+    uint64_t n = argc > 1 ? strtoull(argv[1], nullptr, 10) : 1000000;
+    uint64_t size = argc > 2 ? strtoull(argv[2], nullptr, 10) : 100;
+    uint64_t m = argc > 3 ? strtoull(argv[3], nullptr, 10) : 1000000;
+    double theta = argc > 4 ? atof(argv[4]) : 0.99;
+
+    std::cout << "keys: " << n << ", value size: " << size << ", lookups: " << m << ", theta: " << theta << std::endl;
+    {
+        KVStore store("./bench_data");
+        store.reset();
+        std::string val(size, 'v');
+        for (uint64_t i = 0; i < n; ++i)
+            store.put(i, val);
+    }
+
+    uint64_t sizes[] = {0, 4 * 1024 * 1024, 32 * 1024 * 1024};
+    for (uint64_t row_cache_size : sizes)
+        run(row_cache_size, n, m, theta);
+
+    KVStore store("./bench_data");
+    store.reset();
+    return 0;
+}
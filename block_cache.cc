@@ -0,0 +1,127 @@
+#include "block_cache.h"
+#include "sstable.h"
+
+BlockCache::BlockCache(uint64_t capacity): next_id(1), hits(0), misses(0)
+{
+    for (auto &shard : shards) {
+        shard.capacity = capacity >> BLOCK_CACHE_SHARD_BITS;
+        shard.usage = 0;
+    }
+}
+
+// 仍被固定的句柄由持有者负责先行释放
+BlockCache::~BlockCache()
+{
+    Clear();
+}
+
+// 同一文件相邻的数据块地址只差几 KB，乘以奇数常数后取高位使它们落在不同的分片
+BlockCache::Shard &BlockCache::ShardOf(uint64_t key)
+{
+    return shards[(key * 0x9e3779b97f4a7c15ULL) >> (64 - BLOCK_CACHE_SHARD_BITS)];
+}
+
+// 调用者持有 shard.mutex：减少一个引用，没有引用时释放数据块；只剩缓存本身的引用时放回 LRU 链表的最前面
+void BlockCache::Unref(Shard &shard, Handle *handle)
+{
+    handle->refs -- ;
+    if (handle->refs == 0) {
+        delete handle->block;
+        delete handle;
+    } else if (handle->refs == 1 && handle->in_cache) {
+        shard.lru.push_front(handle);
+        handle->pos = shard.lru.begin();
+    }
+}
+
+// 调用者持有 shard.mutex 并负责从 table 中移除：将 handle 移出缓存，固定它的调用者仍可以继续使用
+void BlockCache::Detach(Shard &shard, Handle *handle)
+{
+    if (handle->refs == 1)
+        shard.lru.erase(handle->pos);
+    handle->in_cache = false;
+    shard.usage -= handle->charge;
+    Unref(shard, handle);
+}
+
+// 调用者持有 shard.mutex：从 LRU 链表末尾淘汰，直到不超过容量或只剩被固定的数据块
+void BlockCache::Evict(Shard &shard)
+{
+    while (shard.usage > shard.capacity && !shard.lru.empty()) {
+        Handle *victim = shard.lru.back();
+        shard.table.erase(victim->key);
+        Detach(shard, victim);
+    }
+}
+
+// 函数返回值 Handle*: 命中时返回固定的句柄，否则为 nullptr
+BlockCache::Handle *BlockCache::Lookup(uint64_t id, uint32_t offset)
+{
+    uint64_t key = Key(id, offset);
+    Shard &shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.table.find(key);
+    if (it == shard.table.end()) {
+        misses ++ ;
+        return nullptr;
+    }
+    hits ++ ;
+    Handle *handle = it->second;
+    if (handle->refs == 1)
+        shard.lru.erase(handle->pos);
+    handle->refs ++ ;
+    return handle;
+}
+
+// 函数参数 block: 新读入的数据块，此后归缓存所有；函数参数 charge: 计入容量的字节数
+// 函数返回值 Handle*: 固定的句柄；并发读入了同一块时替换旧的数据块，旧块在其使用者释放后删除
+BlockCache::Handle *BlockCache::Insert(uint64_t id, uint32_t offset, DataBlock *block, uint64_t charge)
+{
+    auto *handle = new Handle;
+    handle->key = Key(id, offset);
+    handle->block = block;
+    handle->charge = charge;
+    handle->refs = 2;
+    handle->in_cache = true;
+
+    Shard &shard = ShardOf(handle->key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.table.find(handle->key);
+    if (it != shard.table.end())
+        Detach(shard, it->second);
+    shard.table[handle->key] = handle;
+    shard.usage += handle->charge;
+    Evict(shard);
+    return handle;
+}
+
+// 释放后数据块可能重新成为可淘汰的，此时才能把固定期间超出的容量收回
+void BlockCache::Release(Handle *handle)
+{
+    Shard &shard = ShardOf(handle->key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Unref(shard, handle);
+    Evict(shard);
+}
+
+// 函数功能：移出全部数据块，被固定的数据块在释放后删除
+void BlockCache::Clear()
+{
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto &entry : shard.table)
+            Detach(shard, entry.second);
+        shard.table.clear();
+    }
+}
+
+// 函数返回值 uint64_t: 缓存中数据块占用的总字节数，包括被固定的数据块
+uint64_t BlockCache::Usage()
+{
+    uint64_t total = 0;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.usage;
+    }
+    return total;
+}
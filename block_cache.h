@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+#define BLOCK_CACHE_SHARD_BITS 4 // 共 16 个分片，各自加锁，并发的 get 很少争用同一把锁
+
+class DataBlock;
+
+// 解压后的数据块的缓存，以文件序号与数据块在文件中的地址为键，容量按字节计算，平均分给各个分片
+// 查找与插入返回固定（pin）的句柄，持有期间数据块不会被淘汰或释放，调用者可以直接读取其中的 value，用完后 Release
+// 每个分片中未被固定的数据块按 LRU 顺序排列，超出容量时从最久未使用的一端淘汰；被固定的数据块不计入淘汰，释放后才能淘汰
+class BlockCache {
+public:
+    struct Handle {
+        uint64_t key;
+        DataBlock *block;
+        uint64_t charge; // 占用的字节数
+        uint32_t refs; // 缓存本身持有一个引用，其余为调用者的固定
+        bool in_cache; // 被替换或清空之后为 false，最后一个引用释放时删除
+        std::list<Handle *>::iterator pos; // 只被缓存引用时在 LRU 链表中的位置
+    };
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        uint64_t capacity;
+        uint64_t usage;
+        std::list<Handle *> lru; // 只被缓存引用的数据块，最近使用的在前
+        std::unordered_map<uint64_t, Handle *> table;
+    };
+
+    Shard shards[1 << BLOCK_CACHE_SHARD_BITS];
+    std::atomic<uint64_t> next_id;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    static uint64_t Key(uint64_t id, uint32_t offset) {return id << 32 | offset;}
+    Shard &ShardOf(uint64_t key);
+    static void Unref(Shard &shard, Handle *handle);
+    static void Detach(Shard &shard, Handle *handle);
+    static void Evict(Shard &shard);
+
+public:
+    explicit BlockCache(uint64_t capacity);
+    ~BlockCache();
+
+    uint64_t NewId() {return next_id ++ ;}
+    Handle *Lookup(uint64_t id, uint32_t offset);
+    Handle *Insert(uint64_t id, uint32_t offset, DataBlock *block, uint64_t charge);
+    void Release(Handle *handle);
+    void Clear();
+    uint64_t Hits() const {return hits;}
+    uint64_t Misses() const {return misses;}
+    uint64_t Usage();
+};
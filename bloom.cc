@@ -0,0 +1,235 @@
+#include "bloom.h"
+#include "MurmurHash3.h"
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BLOOM_X86
+#include <immintrin.h>
+#endif
+
+// 函数功能：num 个键、每个键 bits_per_key 位所需的字节数，至少 8 字节
+uint32_t BloomFilter::Bytes(uint64_t num, int bits_per_key)
+{
+    uint64_t bits = num * bits_per_key;
+    uint64_t bytes = (bits + 7) / 8;
+    return bytes < 8 ? 8 : (uint32_t) bytes;
+}
+
+uint32_t BloomFilter::Probes(int bits_per_key)
+{
+    int probes = (int) (bits_per_key * 0.69); // ln2 ≈ 0.69
+    if (probes < 1) probes = 1;
+    if (probes > 30) probes = 30;
+    return probes;
+}
+
+void BloomFilter::Hash(uint64_t key, uint64_t hash[2])
+{
+    MurmurHash3_x64_128(&key, sizeof(uint64_t), 1, hash);
+}
+
+void BloomFilter::Add(uint8_t *filter, uint32_t bytes, uint32_t probes, const uint64_t hash[2])
+{
+    uint64_t bits = (uint64_t) bytes * 8;
+    uint64_t h = hash[0];
+    uint64_t delta = hash[1] | 1; // 奇数步长，保证各次探测的位置不同
+    for (uint32_t i = 0; i < probes; ++i) {
+        uint64_t pos = h % bits;
+        filter[pos >> 3] |= (uint8_t) (1 << (pos & 7));
+        h += delta;
+    }
+}
+
+bool BloomFilter::MayContain(const uint8_t *filter, uint32_t bytes, uint32_t probes, const uint64_t hash[2])
+{
+    uint64_t bits = (uint64_t) bytes * 8;
+    uint64_t h = hash[0];
+    uint64_t delta = hash[1] | 1;
+    for (uint32_t i = 0; i < probes; ++i) {
+        uint64_t pos = h % bits;
+        if (!(filter[pos >> 3] & (1 << (pos & 7))))
+            return false;
+        h += delta;
+    }
+    return true;
+}
+
+// 函数功能：num 个键、每个键 bits_per_key 位所需的块数向上取整，至少一块
+uint32_t BloomFilter::BlockedBytes(uint64_t num, int bits_per_key)
+{
+    uint64_t bits = num * bits_per_key;
+    uint64_t blocks = (bits + BLOOM_BLOCK_BYTES * 8 - 1) / (BLOOM_BLOCK_BYTES * 8);
+    return (uint32_t) (blocks < 1 ? 1 : blocks) * BLOOM_BLOCK_BYTES;
+}
+
+// 函数返回值 uint32_t: 分块布局的探测次数，即 Probes(bits_per_key)，但不超过块中字的个数
+uint32_t BloomFilter::BlockedProbes(int bits_per_key)
+{
+    uint32_t probes = Probes(bits_per_key);
+    return probes > BLOOM_BLOCK_PROBES ? BLOOM_BLOCK_PROBES : probes;
+}
+
+// 用 hash[0] 的高 32 位乘块数取高位选块，避免取模运算
+static inline const uint8_t *block_of(const uint8_t *filter, uint32_t bytes, const uint64_t hash[2])
+{
+    uint64_t blocks = bytes / BLOOM_BLOCK_BYTES;
+    return filter + ((hash[0] >> 32) * blocks >> 32) * BLOOM_BLOCK_BYTES;
+}
+
+// 块内的探测从第 hash[0] % 8 个字开始，依次探测 probes 个字（越过末尾回到第 0 个字），第 j 个字取 hash[1] 的第 j 段
+// 探测次数少于 8 时各个键用到的字错开，整个块的比特都能用上；探测 8 次时与起点无关
+static inline uint32_t first_word(const uint64_t hash[2])
+{
+    return (uint32_t) (hash[0] & (BLOOM_BLOCK_PROBES - 1));
+}
+
+void BloomFilter::BlockedAdd(uint8_t *filter, uint32_t bytes, uint32_t probes, const uint64_t hash[2])
+{
+    uint8_t *block = (uint8_t *) block_of(filter, bytes, hash);
+    for (uint32_t i = 0; i < probes; ++i) {
+        uint32_t j = (first_word(hash) + i) & (BLOOM_BLOCK_PROBES - 1);
+        uint64_t word;
+        memcpy(&word, block + 8 * j, sizeof(uint64_t));
+        word |= 1ULL << ((hash[1] >> (6 * j)) & 63);
+        memcpy(block + 8 * j, &word, sizeof(uint64_t));
+    }
+}
+
+// 函数参数 h: hash[1]；函数参数 first: 探测的第一个字
+bool BloomFilter::BlockScalar(const uint8_t *block, uint64_t h, uint32_t first, uint32_t probes)
+{
+    for (uint32_t i = 0; i < probes; ++i) {
+        uint32_t j = (first + i) & (BLOOM_BLOCK_PROBES - 1);
+        uint64_t word;
+        memcpy(&word, block + 8 * j, sizeof(uint64_t));
+        if (!(word & (1ULL << ((h >> (6 * j)) & 63))))
+            return false;
+    }
+    return true;
+}
+
+#ifdef BLOOM_X86
+// SSE2 没有按元素移位的指令，8 个掩码逐个算出（不探测的字掩码为 0），再两个字一组与块中的数据比较
+__attribute__((target("sse2")))
+bool BloomFilter::BlockSSE2(const uint8_t *block, uint64_t h, uint32_t first, uint32_t probes)
+{
+    alignas(16) uint64_t mask[BLOOM_BLOCK_PROBES];
+    for (uint32_t j = 0; j < BLOOM_BLOCK_PROBES; ++j)
+        mask[j] = ((j - first) & (BLOOM_BLOCK_PROBES - 1)) < probes ? 1ULL << ((h >> (6 * j)) & 63) : 0;
+
+    __m128i miss = _mm_setzero_si128();
+    for (int i = 0; i < BLOOM_BLOCK_PROBES / 2; ++i) {
+        __m128i m = _mm_load_si128((const __m128i *) mask + i);
+        __m128i b = _mm_load_si128((const __m128i *) block + i);
+        miss = _mm_or_si128(miss, _mm_andnot_si128(b, m)); // 掩码中有块里没有置位的位
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(miss, _mm_setzero_si128())) == 0xffff;
+}
+
+// AVX2 用可变移位一次算出 4 个掩码，按各字到起点的距离清掉不探测的字，testc 判断块中是否包含掩码的全部位
+__attribute__((target("avx2")))
+bool BloomFilter::BlockAVX2(const uint8_t *block, uint64_t h, uint32_t first, uint32_t probes)
+{
+    const __m256i low = _mm256_setr_epi64x(0, 6, 12, 18);
+    const __m256i high = _mm256_setr_epi64x(24, 30, 36, 42);
+    const __m256i words_low = _mm256_setr_epi64x(8, 9, 10, 11); // 加 8 使减去起点后不为负
+    const __m256i words_high = _mm256_setr_epi64x(12, 13, 14, 15);
+    const __m256i seven = _mm256_set1_epi64x(BLOOM_BLOCK_PROBES - 1);
+    const __m256i bits = _mm256_set1_epi64x(63);
+    const __m256i one = _mm256_set1_epi64x(1);
+    __m256i hv = _mm256_set1_epi64x((long long) h);
+    __m256i start = _mm256_set1_epi64x(first);
+    __m256i k = _mm256_set1_epi64x(probes);
+
+    __m256i m0 = _mm256_sllv_epi64(one, _mm256_and_si256(_mm256_srlv_epi64(hv, low), bits));
+    __m256i m1 = _mm256_sllv_epi64(one, _mm256_and_si256(_mm256_srlv_epi64(hv, high), bits));
+    __m256i d0 = _mm256_and_si256(_mm256_sub_epi64(words_low, start), seven);
+    __m256i d1 = _mm256_and_si256(_mm256_sub_epi64(words_high, start), seven);
+    m0 = _mm256_and_si256(m0, _mm256_cmpgt_epi64(k, d0));
+    m1 = _mm256_and_si256(m1, _mm256_cmpgt_epi64(k, d1));
+    __m256i b0 = _mm256_load_si256((const __m256i *) block);
+    __m256i b1 = _mm256_load_si256((const __m256i *) block + 1);
+    return _mm256_testc_si256(b0, m0) & _mm256_testc_si256(b1, m1);
+}
+
+bool BloomFilter::HasSSE2()
+{
+    return __builtin_cpu_supports("sse2");
+}
+
+bool BloomFilter::HasAVX2()
+{
+    return __builtin_cpu_supports("avx2");
+}
+#else
+bool BloomFilter::BlockSSE2(const uint8_t *block, uint64_t h, uint32_t first, uint32_t probes)
+{
+    return BlockScalar(block, h, first, probes);
+}
+
+bool BloomFilter::BlockAVX2(const uint8_t *block, uint64_t h, uint32_t first, uint32_t probes)
+{
+    return BlockScalar(block, h, first, probes);
+}
+
+bool BloomFilter::HasSSE2()
+{
+    return false;
+}
+
+bool BloomFilter::HasAVX2()
+{
+    return false;
+}
+#endif
+
+typedef bool (*block_kernel)(const uint8_t *, uint64_t, uint32_t, uint32_t);
+
+// 第一次调用时检测 CPU，之后固定使用同一个内核
+static block_kernel kernel()
+{
+    static const block_kernel chosen = BloomFilter::HasAVX2() ? BloomFilter::BlockAVX2
+                                     : BloomFilter::HasSSE2() ? BloomFilter::BlockSSE2
+                                     : BloomFilter::BlockScalar;
+    return chosen;
+}
+
+const char *BloomFilter::KernelName()
+{
+    block_kernel k = kernel();
+    return k == BlockAVX2 ? "avx2" : k == BlockSSE2 ? "sse2" : "scalar";
+}
+
+// 文件中读入的 Bloom Filter 由 Allocate 分配，块与缓存行对齐，SIMD 内核可以直接按对齐方式读取
+bool BloomFilter::BlockedMayContain(const uint8_t *filter, uint32_t bytes, uint32_t probes, const uint64_t hash[2])
+{
+    return kernel()(block_of(filter, bytes, hash), hash[1], first_word(hash), probes);
+}
+
+// 多分配一个块的空间，对齐后的地址前一个字节记录偏移量，释放时据此找回原地址
+uint8_t *BloomFilter::Allocate(uint32_t bytes)
+{
+    auto *raw = new uint8_t [bytes + BLOOM_BLOCK_BYTES]();
+    uint8_t shift = (uint8_t) (BLOOM_BLOCK_BYTES - (uintptr_t) raw % BLOOM_BLOCK_BYTES);
+    uint8_t *filter = raw + shift;
+    filter[-1] = shift;
+    return filter;
+}
+
+void BloomFilter::Release(uint8_t *filter)
+{
+    if (filter != nullptr)
+        delete [] (filter - filter[-1]);
+}
+
+// 旧格式把 128 位哈希值看作 4 个 32 位整数，std::bitset 的第 i 位即第 i / 8 个字节的第 i % 8 位
+bool BloomFilter::LegacyMayContain(const uint8_t *filter, const uint64_t hash[2])
+{
+    uint32_t parts[4] = {(uint32_t) hash[0], (uint32_t) (hash[0] >> 32), (uint32_t) hash[1], (uint32_t) (hash[1] >> 32)};
+    for (int i = 0; i < 4; ++i) {
+        uint32_t pos = parts[i] % 81920;
+        if (!(filter[pos >> 3] & (1 << (pos & 7))))
+            return false;
+    }
+    return true;
+}
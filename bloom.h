@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#define BLOOM_BLOCK_BYTES 64 // 分块 Bloom Filter 每块的字节数
+#define BLOOM_BLOCK_PROBES 8 // 每块 8 个 64 位字，每次探测在其中一个字中置一位，探测次数至多为 8
+
+// Bloom Filter：大小由键值对数量与每个键的比特数决定，哈希次数取使误判率最低的 bits_per_key * ln2
+// 每个键只计算一次 MurmurHash3，得到的两个 64 位哈希值用双重哈希生成全部探测位置
+class BloomFilter {
+public:
+    static uint32_t Bytes(uint64_t num, int bits_per_key);
+    static uint32_t Probes(int bits_per_key);
+
+    static void Hash(uint64_t key, uint64_t hash[2]);
+    static void Add(uint8_t *filter, uint32_t bytes, uint32_t probes, const uint64_t hash[2]);
+    static bool MayContain(const uint8_t *filter, uint32_t bytes, uint32_t probes, const uint64_t hash[2]);
+
+    // 分块 Bloom Filter：hash[0] 选出一个 64 字节的块（恰好一个缓存行），hash[1] 的低 48 位分成 8 段，
+    // 块内每个 64 位字至多探测一次，在第 j 个字中置第 j 段所指的位，一次查找只访问一个缓存行，全部探测可以用 SIMD 指令同时完成
+    // 探测次数与标准布局一样由 bits_per_key 决定（至多 8 次），记录在文件头中，每个键的比特数较少时不会因探测过多而把块填满
+    static uint32_t BlockedBytes(uint64_t num, int bits_per_key);
+    static uint32_t BlockedProbes(int bits_per_key);
+    static void BlockedAdd(uint8_t *filter, uint32_t bytes, uint32_t probes, const uint64_t hash[2]);
+    static bool BlockedMayContain(const uint8_t *filter, uint32_t bytes, uint32_t probes, const uint64_t hash[2]);
+
+    // 单个块的探测内核，运行时按 CPU 支持的指令集选用其一，基准测试可以分别调用
+    static bool BlockScalar(const uint8_t *block, uint64_t h, uint32_t first, uint32_t probes);
+    static bool BlockSSE2(const uint8_t *block, uint64_t h, uint32_t first, uint32_t probes);
+    static bool BlockAVX2(const uint8_t *block, uint64_t h, uint32_t first, uint32_t probes);
+    static bool HasSSE2();
+    static bool HasAVX2();
+    static const char *KernelName();
+
+    // 按 64 字节对齐分配清零的内存，保证每个块不跨越缓存行
+    static uint8_t *Allocate(uint32_t bytes);
+    static void Release(uint8_t *filter);
+
+    // 旧格式的 sst 文件：固定 81920 位，4 个 32 位哈希值分别取模
+    static bool LegacyMayContain(const uint8_t *filter, const uint64_t hash[2]);
+};
@@ -0,0 +1,187 @@
+#include "compress.h"
+#include <cstring>
+
+#ifdef LSMKV_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+bool Compressor::Supported(CompressionType type)
+{
+    switch (type) {
+    case NO_COMPRESSION:
+    case LZ_COMPRESSION:
+        return true;
+    case ZLIB_COMPRESSION:
+#ifdef LSMKV_HAVE_ZLIB
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char *Compressor::Name(CompressionType type)
+{
+    switch (type) {
+    case NO_COMPRESSION: return "none";
+    case LZ_COMPRESSION: return "lz";
+    case ZLIB_COMPRESSION: return "zlib";
+    }
+    return "unknown";
+}
+
+// 函数返回值 bool: 不支持该压缩方式时返回 false，out 不变
+bool Compressor::Compress(CompressionType type, const char *src, size_t n, std::string &out)
+{
+    switch (type) {
+    case LZ_COMPRESSION:
+        LZCompress(src, n, out);
+        return true;
+    case ZLIB_COMPRESSION: {
+#ifdef LSMKV_HAVE_ZLIB
+        uLongf len = compressBound(n);
+        size_t start = out.size();
+        out.resize(start + len);
+        if (compress2((Bytef *) &out[start], &len, (const Bytef *) src, n, Z_DEFAULT_COMPRESSION) != Z_OK) {
+            out.resize(start);
+            return false;
+        }
+        out.resize(start + len);
+        return true;
+#else
+        return false;
+#endif
+    }
+    default:
+        return false;
+    }
+}
+
+// 函数参数 raw_len: 解压后的字节数，由调用者另行记录；解压结果与之不符时返回 false
+bool Compressor::Decompress(CompressionType type, const char *src, size_t n, char *dst, size_t raw_len)
+{
+    switch (type) {
+    case LZ_COMPRESSION:
+        return LZDecompress(src, n, dst, raw_len);
+    case ZLIB_COMPRESSION: {
+#ifdef LSMKV_HAVE_ZLIB
+        uLongf len = raw_len;
+        return uncompress((Bytef *) dst, &len, (const Bytef *) src, n) == Z_OK && len == raw_len;
+#else
+        return false;
+#endif
+    }
+    default:
+        return false;
+    }
+}
+
+// 长度超过 15 时在标记字节之后追加若干个 255 与余数
+static void put_length(std::string &out, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        out.push_back((char) 255);
+    out.push_back((char) len);
+}
+
+// 一个序列：标记字节（高 4 位字面量长度，低 4 位匹配长度 - 4）+ 字面量 + 2 字节偏移 + 匹配长度的扩展
+static void put_sequence(std::string &out, const char *literal, size_t literal_len, size_t offset, size_t match_len)
+{
+    size_t extra = match_len >= LZ_MIN_MATCH ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t token = (uint8_t) ((literal_len < 15 ? literal_len : 15) << 4 | (extra < 15 ? extra : 15));
+    out.push_back((char) token);
+    if (literal_len >= 15)
+        put_length(out, literal_len - 15);
+    out.append(literal, literal_len);
+    if (match_len == 0)
+        return;
+    out.push_back((char) (offset & 0xff));
+    out.push_back((char) (offset >> 8));
+    if (extra >= 15)
+        put_length(out, extra - 15);
+}
+
+// 函数功能：用 4 字节序列的哈希表寻找 64KB 以内的重复串；长时间找不到匹配时加大步长，不可压缩的数据也能很快处理完
+void Compressor::LZCompress(const char *src, size_t n, std::string &out)
+{
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0xff, sizeof(table));
+
+    size_t anchor = 0, i = 0;
+    while (i + LZ_MIN_MATCH <= n) {
+        uint32_t seq;
+        memcpy(&seq, src + i, sizeof(uint32_t));
+        uint32_t h = (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+        uint32_t candidate = table[h];
+        table[h] = (uint32_t) i;
+
+        if (candidate != UINT32_MAX && i - candidate <= LZ_MAX_OFFSET && memcmp(src + candidate, src + i, LZ_MIN_MATCH) == 0) {
+            size_t len = LZ_MIN_MATCH;
+            while (i + len < n && src[candidate + len] == src[i + len])
+                len ++ ;
+            put_sequence(out, src + anchor, i - anchor, i - candidate, len);
+            i += len;
+            anchor = i;
+        } else {
+            i += 1 + ((i - anchor) >> 6);
+        }
+    }
+    put_sequence(out, src + anchor, n - anchor, 0, 0); // 最后一个序列只有字面量
+}
+
+// 读取扩展长度，越界时返回 false
+static bool get_length(const uint8_t *&ip, const uint8_t *end, size_t &len)
+{
+    uint8_t b;
+    do {
+        if (ip == end)
+            return false;
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+// 函数功能：逐个序列解码，所有长度与偏移都检查边界，损坏的输入只会返回 false
+bool Compressor::LZDecompress(const char *src, size_t n, char *dst, size_t raw_len)
+{
+    const uint8_t *ip = (const uint8_t *) src, *end = ip + n;
+    size_t op = 0;
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !get_length(ip, end, literal_len))
+            return false;
+        if (literal_len > (size_t) (end - ip) || literal_len > raw_len - op)
+            return false;
+        memcpy(dst + op, ip, literal_len);
+        ip += literal_len;
+        op += literal_len;
+        if (ip == end)
+            break;
+
+        if (end - ip < 2)
+            return false;
+        size_t offset = ip[0] | (size_t) ip[1] << 8;
+        ip += 2;
+        size_t match_len = token & 15;
+        if (match_len == 15 && !get_length(ip, end, match_len))
+            return false;
+        match_len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || match_len > raw_len - op)
+            return false;
+        if (offset >= match_len) {
+            memcpy(dst + op, dst + op - offset, match_len);
+            op += match_len;
+        } else {
+            for (size_t k = 0; k < match_len; ++k, ++op) // 偏移小于长度时源与目标重叠，逐字节复制
+                dst[op] = dst[op - offset];
+        }
+    }
+    return op == raw_len;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "options.h"
+
+// 数据块的压缩与解压：LZ 为内置的 LZ77 编码（与 LZ4 的序列格式类似），
+// ZLIB 只在编译时找到 zlib 时可用（定义 LSMKV_HAVE_ZLIB），否则写入时按不压缩处理
+class Compressor {
+public:
+    static bool Supported(CompressionType type);
+    static bool Compress(CompressionType type, const char *src, size_t n, std::string &out);
+    static bool Decompress(CompressionType type, const char *src, size_t n, char *dst, size_t raw_len);
+    static const char *Name(CompressionType type);
+
+    static void LZCompress(const char *src, size_t n, std::string &out);
+    static bool LZDecompress(const char *src, size_t n, char *dst, size_t raw_len);
+};
@@ -1,6 +1,12 @@
 #include <iostream>
 #include <cstdint>
 #include <string>
+#include <vector>
+#include <list>
+#include <thread>
+#include <atomic>
+#include <fstream>
+#include <unistd.h>
 
 #include "test.h"
 
@@ -101,8 +107,269 @@ private:
 		report();
 	}
 
+	// Apply a range deletion to both the store and the expected contents
+	void range_delete(KVStore &kv, std::vector<std::string> &expected,
+			  uint64_t begin, uint64_t end)
+	{
+		kv.delete_range(begin, end);
+		for (uint64_t i = begin; i <= end && i < expected.size(); ++i)
+			expected[i] = not_found;
+	}
+
+	// Check every key with get and the whole key space with scan
+	void check_range(KVStore &kv, const std::vector<std::string> &expected)
+	{
+		uint64_t i;
+		std::list<std::pair<uint64_t, std::string> > list_ans;
+		std::list<std::pair<uint64_t, std::string> > list_stu;
+
+		for (i = 0; i < expected.size(); ++i) {
+			EXPECT(expected[i], kv.get(i));
+			if (expected[i] != not_found)
+				list_ans.emplace_back(std::make_pair(i, expected[i]));
+		}
+
+		kv.scan(0, expected.size() - 1, list_stu);
+		EXPECT(list_ans.size(), list_stu.size());
+		auto ap = list_ans.begin();
+		auto sp = list_stu.begin();
+		while (ap != list_ans.end() && sp != list_stu.end()) {
+			EXPECT((*ap).first, (*sp).first);
+			EXPECT((*ap).second, (*sp).second);
+			ap++;
+			sp++;
+		}
+	}
+
+	void range_delete_test(uint64_t max)
+	{
+		uint64_t i;
+		std::vector<std::string> expected(max);
+		uint64_t compactions = store.GetCompactionStats().count;
+
+		// Test overlapping ranges, part of the data already on disk
+		for (i = 0; i < max; ++i) {
+			expected[i] = std::string(i % 64 + 1, 'r');
+			store.put(i, expected[i]);
+		}
+		store.Flush();
+		range_delete(store, expected, max / 4, max / 2);
+		range_delete(store, expected, max / 8 * 3, max / 8 * 5);
+		range_delete(store, expected, max / 2, max / 2);
+		EXPECT(false, store.del(max / 2));
+		EXPECT(true, store.del(max / 8 * 5 + 1));
+		expected[max / 8 * 5 + 1] = not_found;
+		check_range(store, expected);
+
+		phase();
+
+		// Test puts after a range delete
+		for (i = max / 4; i <= max / 8 * 5; i += 3) {
+			expected[i] = std::string(i % 64 + 1, 'p');
+			store.put(i, expected[i]);
+		}
+		EXPECT(true, store.del(max / 4));
+		expected[max / 4] = not_found;
+		range_delete(store, expected, max / 8 * 5 - 8, max / 4 * 3);
+		store.put(max / 4 * 3, "after");
+		expected[max / 4 * 3] = "after";
+		check_range(store, expected);
+
+		phase();
+
+		// Test after flushes and compaction
+		store.Flush();
+		for (i = max / 4 * 3; i < max; ++i) {
+			expected[i] = std::string(i % 64 + 1, 'c');
+			store.put(i, expected[i]);
+		}
+		store.Flush();
+		range_delete(store, expected, max / 8 * 7, max / 16 * 15);
+		store.put(max / 8 * 7, "flushed");
+		expected[max / 8 * 7] = "flushed";
+		store.Flush();
+		EXPECT(true, store.GetCompactionStats().count > compactions);
+		check_range(store, expected);
+
+		phase();
+
+		// Test reopen, ranges both in the MemTable and in SSTables
+		std::vector<std::string> reopened(max);
+		{
+			KVStore kv(reopen_dir);
+			kv.reset();
+			for (i = 0; i < max; ++i) {
+				reopened[i] = std::string(i % 64 + 1, 'o');
+				kv.put(i, reopened[i]);
+			}
+			range_delete(kv, reopened, max / 8, max / 4);
+			kv.Flush();
+			range_delete(kv, reopened, max / 8 * 3, max / 2);
+			kv.put(max / 2, "reopened");
+			reopened[max / 2] = "reopened";
+		}
+		for (i = 0; i < 2; ++i) {
+			KVStore kv(reopen_dir);
+			check_range(kv, reopened);
+		}
+		{
+			KVStore kv(reopen_dir);
+			kv.reset();
+		}
+
+		// Test deleting the whole key space
+		range_delete(store, expected, 0, max - 1);
+		check_range(store, expected);
+
+		phase();
+
+		report();
+	}
+
+	// Value written by the v-th batch, the number first so that readers can compare versions
+	static std::string batch_value(uint64_t v)
+	{
+		std::string s = std::to_string(v);
+		s.resize(40, 'b');
+		return s;
+	}
+
+	// Append each batch to the WAL of reopen_dir as one TYPE_BATCH record
+	// and return the file size after each of them
+	std::vector<uint64_t> write_log(const std::vector<WriteBatch> &batches)
+	{
+		std::vector<uint64_t> sizes;
+		std::string path = reopen_dir + "/wal.log";
+		WriteAheadLog log(path, SYNC_EVERY_WRITE, 0);
+		for (auto &batch : batches) {
+			std::vector<const LogRecord *> records;
+			for (auto &record : batch.Records())
+				records.push_back(&record);
+			log.AppendBatch(records);
+			std::ifstream in(path, std::ios::binary | std::ios::ate);
+			sizes.push_back(in.tellg());
+		}
+		return sizes;
+	}
+
+	void batch_test(uint64_t max)
+	{
+		uint64_t i;
+		const uint64_t BATCH_KEYS = 10;
+		const uint64_t base = max * 2; // keys of the batches
+		const uint64_t noise = max * 4; // keys of concurrent puts
+
+		// Test readers never see half of a batch: every batch sets all its
+		// keys to the same version, every other one after a range delete
+		WriteBatch first;
+		for (i = 0; i < BATCH_KEYS; ++i)
+			first.Put(base + i, batch_value(1));
+		EXPECT(true, store.write(first));
+
+		std::atomic<bool> stop(false);
+		std::atomic<uint64_t> torn(0), failed(0);
+		std::thread writer([&]() {
+			for (uint64_t v = 2; v < max; ++v) {
+				WriteBatch batch;
+				if (v % 2 == 0)
+					batch.DeleteRange(base, base + BATCH_KEYS - 1);
+				for (uint64_t k = 0; k < BATCH_KEYS; ++k)
+					batch.Put(base + k, batch_value(v));
+				if (!store.write(batch))
+					failed++;
+			}
+			stop = true;
+		});
+		std::thread filler([&]() { // switch MemTables while batches are written
+			for (uint64_t k = 0; !stop; ++k)
+				store.put(noise + k % max, std::string(256, 'n'));
+		});
+		std::thread getter([&]() { // keys read in batch order never go back to an older version
+			while (!stop) {
+				uint64_t prev = 0;
+				for (uint64_t k = 0; k < BATCH_KEYS; ++k) {
+					std::string val = store.get(base + k);
+					uint64_t v = strtoull(val.c_str(), nullptr, 10);
+					if (val.empty() || v < prev)
+						torn++;
+					prev = v;
+				}
+			}
+		});
+		std::thread scanner([&]() { // an iterator sees exactly one version
+			while (!stop) {
+				Iterator *iter = store.NewIterator(base, base + BATCH_KEYS - 1);
+				uint64_t count = 0;
+				std::string val = iter->Valid() ? iter->value() : not_found;
+				for ( ; iter->Valid(); iter->Next(), ++count)
+					if (iter->value() != val)
+						torn++;
+				if (count != BATCH_KEYS)
+					torn++;
+				delete iter;
+			}
+		});
+		writer.join();
+		filler.join();
+		getter.join();
+		scanner.join();
+		EXPECT((uint64_t) 0, failed.load());
+		EXPECT((uint64_t) 0, torn.load());
+		for (i = 0; i < BATCH_KEYS; ++i)
+			EXPECT(batch_value(max - 1), store.get(base + i));
+		store.delete_range(base, noise + max - 1);
+
+		phase();
+
+		// Test a batch replayed from the WAL is all or nothing: the first
+		// batch is complete, the second one is cut or corrupted
+		std::vector<WriteBatch> batches(2);
+		for (i = 0; i < BATCH_KEYS; ++i) {
+			batches[0].Put(i, batch_value(1));
+			batches[1].Put(i + BATCH_KEYS / 2, batch_value(2));
+		}
+		batches[0].Delete(BATCH_KEYS / 2);
+		batches[1].DeleteRange(0, 1);
+
+		for (int crash = 0; crash < 3; ++crash) {
+			{
+				KVStore kv(reopen_dir);
+				kv.reset();
+			}
+			std::vector<uint64_t> sizes = write_log(batches);
+			std::string path = reopen_dir + "/wal.log";
+			if (crash == 0) {
+				// Cut inside the second record
+				EXPECT(0, truncate(path.c_str(), (sizes[0] + sizes[1]) / 2));
+			} else if (crash == 1) {
+				// Flip a byte of the last value in the second record
+				std::fstream f(path, std::ios::binary | std::ios::in | std::ios::out);
+				f.seekp(sizes[1] - 1);
+				f.put('x');
+			}
+
+			KVStore kv(reopen_dir);
+			for (i = 0; i < BATCH_KEYS * 2; ++i) {
+				std::string expected = not_found;
+				if (crash == 2 && i >= BATCH_KEYS / 2 && i < BATCH_KEYS / 2 * 3)
+					expected = batch_value(2);
+				else if (i < BATCH_KEYS && i != BATCH_KEYS / 2 && (crash != 2 || i > 1))
+					expected = batch_value(1);
+				EXPECT(expected, kv.get(i));
+			}
+			kv.reset();
+		}
+
+		phase();
+
+		report();
+	}
+
+	std::string reopen_dir;
+
 public:
-	CorrectnessTest(const std::string &dir, bool v=true) : Test(dir, v)
+	CorrectnessTest(const std::string &dir, bool v=true) : Test(dir, v),
+		reopen_dir(dir + "_reopen")
 	{
 	}
 
@@ -112,9 +379,13 @@ public:
 
 		std::cout << "[Simple Test]" << std::endl;
 		regular_test(SIMPLE_TEST_MAX);
+		range_delete_test(SIMPLE_TEST_MAX);
+		batch_test(SIMPLE_TEST_MAX);
 
 		std::cout << "[Large Test]" << std::endl;
 		regular_test(LARGE_TEST_MAX);
+		range_delete_test(LARGE_TEST_MAX);
+		batch_test(LARGE_TEST_MAX);
 	}
 };
 
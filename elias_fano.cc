@@ -0,0 +1,208 @@
+#include "elias_fano.h"
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define EF_X86
+#include <immintrin.h>
+#endif
+
+// 函数参数 values: 单调不减的序列；函数参数 count: 序列长度
+// 函数功能：低位位数取 floor(log2(值域 / 个数))，使编码总长度最短
+void EliasFano::Build(const uint64_t *values, uint64_t count)
+{
+    n = count;
+    base = count > 0 ? values[0] : 0;
+    low_bits = 0;
+    lower.clear();
+    upper.clear();
+
+    uint64_t range = count > 0 ? values[count - 1] - base : 0;
+    if (count > 0 && range / count > 0)
+        low_bits = 63 - __builtin_clzll(range / count);
+
+    lower.assign((count * low_bits + 63) / 64, 0);
+    upper.assign((count + (range >> low_bits) + 1 + 63) / 64, 0);
+
+    uint64_t mask = low_bits == 0 ? 0 : (~0ULL >> (64 - low_bits));
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t x = values[i] - base;
+        uint64_t low = x & mask;
+        uint64_t bit = i * low_bits;
+        if (low_bits > 0) {
+            lower[bit / 64] |= low << (bit % 64);
+            if (bit % 64 + low_bits > 64)
+                lower[bit / 64 + 1] |= low >> (64 - bit % 64);
+        }
+        uint64_t pos = (x >> low_bits) + i;
+        upper[pos / 64] |= 1ULL << (pos % 64);
+    }
+    BuildSamples();
+}
+
+void EliasFano::BuildSamples()
+{
+    samples.clear();
+    uint32_t ones = 0;
+    for (size_t w = 0; w < upper.size(); ++w) {
+        if (w % 8 == 0)
+            samples.push_back(ones);
+        ones += __builtin_popcountll(upper[w]);
+    }
+}
+
+// 格式：最小值(8) + 低位位数(4) + 高位的字数(4) + 低位各字 + 高位各字，select 所需的采样在读入时重建
+void EliasFano::Encode(std::string &out) const
+{
+    uint32_t upper_words = upper.size();
+    out.append((char*)&base, sizeof(uint64_t));
+    out.append((char*)&low_bits, sizeof(uint32_t));
+    out.append((char*)&upper_words, sizeof(uint32_t));
+    out.append((char*)lower.data(), 8 * lower.size());
+    out.append((char*)upper.data(), 8 * upper.size());
+}
+
+// 函数参数 count: 序列长度，由调用者另行记录
+// 函数返回值 bool: 长度与内容相符时返回 true
+bool EliasFano::Decode(const char *data, uint64_t length, uint64_t count)
+{
+    if (length < 16)
+        return false;
+    uint32_t upper_words;
+    memcpy(&base, data, sizeof(uint64_t));
+    memcpy(&low_bits, data + 8, sizeof(uint32_t));
+    memcpy(&upper_words, data + 12, sizeof(uint32_t));
+    if (low_bits > 63)
+        return false;
+
+    uint64_t lower_words = (count * low_bits + 63) / 64;
+    if (length != 16 + 8 * (lower_words + upper_words))
+        return false;
+
+    n = count;
+    lower.resize(lower_words);
+    upper.resize(upper_words);
+    // low_bits 为 0 时没有低位，空的 vector 的 data() 可能为空指针，不能传给 memcpy
+    if (lower_words > 0)
+        memcpy(lower.data(), data + 16, 8 * lower_words);
+    if (upper_words > 0)
+        memcpy(upper.data(), data + 16 + 8 * lower_words, 8 * upper_words);
+
+    uint64_t ones = 0;
+    for (auto word : upper)
+        ones += __builtin_popcountll(word);
+    if (ones != n)
+        return false;
+    BuildSamples();
+    return true;
+}
+
+uint64_t EliasFano::Low(uint64_t i) const
+{
+    if (low_bits == 0)
+        return 0;
+    uint64_t bit = i * low_bits;
+    uint64_t low = lower[bit / 64] >> (bit % 64);
+    if (bit % 64 + low_bits > 64)
+        low |= lower[bit / 64 + 1] << (64 - bit % 64);
+    return low & (~0ULL >> (64 - low_bits));
+}
+
+#ifdef EF_X86
+// BMI2 的 pdep 把 1 << i 存入 word 中第 i 个为 1 的位，一条指令完成字内的 select
+__attribute__((target("bmi2")))
+static uint64_t select_pdep(uint64_t word, uint64_t i)
+{
+    return __builtin_ctzll(_pdep_u64(1ULL << i, word));
+}
+
+static const bool has_bmi2 = __builtin_cpu_supports("bmi2");
+#endif
+
+// 返回字 word 中第 i 个（从 0 开始）为 1 的位：不支持 pdep 时先按字节跳过，再在字节内逐个清除
+static inline uint64_t select_in_word(uint64_t word, uint64_t i)
+{
+#ifdef EF_X86
+    if (has_bmi2)
+        return select_pdep(word, i);
+#endif
+    uint64_t shift = 0;
+    while (true) {
+        uint64_t ones = __builtin_popcountll((word >> shift) & 0xff);
+        if (i < ones)
+            break;
+        i -= ones;
+        shift += 8;
+    }
+    word >>= shift;
+    for (; i > 0; --i)
+        word &= word - 1;
+    return shift + __builtin_ctzll(word);
+}
+
+// 函数功能：第 i 个 1 所在的位置，先在采样中二分查找所在的 512 位，再逐字统计
+uint64_t EliasFano::Select1(uint64_t i) const
+{
+    size_t s = std::upper_bound(samples.begin(), samples.end(), (uint32_t) i) - samples.begin() - 1;
+    i -= samples[s];
+    for (size_t w = s * 8; ; ++w) {
+        uint64_t ones = __builtin_popcountll(upper[w]);
+        if (i < ones)
+            return w * 64 + select_in_word(upper[w], i);
+        i -= ones;
+    }
+}
+
+// 函数功能：第 i 个 0 所在的位置，不存在时返回高位的总位数
+uint64_t EliasFano::Select0(uint64_t i) const
+{
+    // 第 s 个采样之前 0 的个数为 512 * s - samples[s]，同样单调不减
+    size_t low = 0, high = samples.size();
+    while (high - low > 1) {
+        size_t middle = (low + high) / 2;
+        if (512 * middle - samples[middle] <= i)
+            low = middle;
+        else
+            high = middle;
+    }
+    i -= 512 * low - samples[low];
+    for (size_t w = low * 8; w < upper.size(); ++w) {
+        uint64_t zeros = 64 - __builtin_popcountll(upper[w]);
+        if (i < zeros)
+            return w * 64 + select_in_word(~upper[w], i);
+        i -= zeros;
+    }
+    return upper.size() * 64;
+}
+
+// 第 i 个 1 之前有几个 0，就是第 i 个值的高位
+uint64_t EliasFano::Get(uint64_t i) const
+{
+    uint64_t high = Select1(i) - i;
+    return base + ((high << low_bits) | Low(i));
+}
+
+// 函数返回值 uint64_t: 第一个不小于 target 的值的脚标，不存在时返回 Size()
+// 函数功能：高位小于 h 的值都排在第 h - 1 个 0 之前，高位等于 h 的值紧随其后，遇到下一个 0 时之后的值都更大
+uint64_t EliasFano::LowerBound(uint64_t target) const
+{
+    if (n == 0 || target <= base)
+        return 0;
+
+    uint64_t h = (target - base) >> low_bits;
+    uint64_t i = 0, pos = 0;
+    if (h > 0) {
+        pos = Select0(h - 1);
+        if (pos >= upper.size() * 64)
+            return n;
+        i = pos - (h - 1);
+        pos ++ ;
+    }
+    for (; i < n; ++i, ++pos) {
+        if (!(upper[pos / 64] >> (pos % 64) & 1))
+            return i;
+        if (((h << low_bits) | Low(i)) >= target - base)
+            return i;
+    }
+    return n;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// 单调不减的 uint64_t 序列的 Elias-Fano 编码：每个值减去最小值后拆成低 low_bits 位与高位，
+// 低位直接拼接，高位以一元码存放（第 i 个值的高位为 h 时第 h + i 位为 1），每个值约占 low_bits + 2 位
+// 每 512 位记录一次之前 1 的个数，Get 与 LowerBound 借助 select 在其中定位
+class EliasFano {
+private:
+    uint64_t n;
+    uint64_t base; // 最小值
+    uint32_t low_bits;
+    std::vector<uint64_t> lower;
+    std::vector<uint64_t> upper;
+    std::vector<uint32_t> samples; // 每 8 个 64 位字之前 1 的个数
+
+    void BuildSamples();
+    uint64_t Low(uint64_t i) const;
+    uint64_t Select1(uint64_t i) const;
+    uint64_t Select0(uint64_t i) const;
+
+public:
+    EliasFano(): n(0), base(0), low_bits(0) {}
+
+    void Build(const uint64_t *values, uint64_t count);
+    void Encode(std::string &out) const;
+    bool Decode(const char *data, uint64_t length, uint64_t count);
+
+    uint64_t Size() const {return n;}
+    uint64_t Get(uint64_t i) const;
+    uint64_t LowerBound(uint64_t target) const;
+    uint64_t EncodedBytes() const {return 16 + 8 * (lower.size() + upper.size());}
+    uint64_t MemoryBytes() const {return sizeof(EliasFano) + 8 * (lower.size() + upper.size()) + 4 * samples.size();}
+};
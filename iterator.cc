@@ -0,0 +1,81 @@
+#include "iterator.h"
+
+// 函数参数 range_dels: 此后归迭代器所有
+MergingIterator::MergingIterator(const std::vector<InternalIterator *> &children, RangeDeletions *range_dels)
+    : children(children), range_dels(range_dels)
+{
+    Rebuild();
+}
+
+MergingIterator::~MergingIterator()
+{
+    for (auto child : children)
+        delete child;
+    delete range_dels;
+}
+
+void MergingIterator::Rebuild()
+{
+    heap = decltype(heap)();
+    for (auto child : children) {
+        if (child->Valid())
+            heap.push(child);
+    }
+}
+
+void MergingIterator::Seek(uint64_t target)
+{
+    for (auto child : children)
+        child->Seek(target);
+    Rebuild();
+}
+
+bool MergingIterator::Covered() const
+{
+    if (range_dels == nullptr)
+        return false;
+    InternalIterator *top = heap.top();
+    return range_dels->Covers(top->key(), top->level(), top->time(), top->seq());
+}
+
+// 弹出当前键的所有版本（堆顶即为最新版本，已经被调用者读取）
+void MergingIterator::Next()
+{
+    uint64_t cur = heap.top()->key();
+    while (!heap.empty() && heap.top()->key() == cur) {
+        InternalIterator *child = heap.top();
+        heap.pop();
+        child->Next();
+        if (child->Valid())
+            heap.push(child);
+    }
+}
+
+Iterator::Iterator(InternalIterator *iter, uint64_t upper, std::shared_ptr<const Version> version)
+    : iter(iter), upper(upper), version(std::move(version))
+{
+}
+
+Iterator::~Iterator()
+{
+    delete iter;
+}
+
+// 删除标记对使用者不可见，跳过直到遇到一个有效的键
+void Iterator::SkipDeleted()
+{
+    while (Valid() && iter->type() == TYPE_DELETION)
+        iter->Next();
+}
+
+void Iterator::Seek(uint64_t target)
+{
+    iter->Seek(target);
+    SkipDeleted();
+}
+
+void Iterator::Next()
+{
+    iter->Next();
+    SkipDeleted();
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include "options.h"
+#include "range_del.h"
+
+class Version;
+
+// 内部迭代器接口：按键升序遍历一个有序的数据源（跳表或 SSTable），同一数据源中每个键只出现一次
+class InternalIterator {
+public:
+    virtual ~InternalIterator() = default;
+
+    virtual bool Valid() const = 0;
+    virtual void Seek(uint64_t target) = 0; // 定位到第一个不小于 target 的键
+    virtual void Next() = 0;
+    virtual uint64_t key() const = 0;
+    virtual const std::string &value() const = 0;
+    virtual ValueType type() const = 0; // 为 TYPE_DELETION 时 value 无意义（旧格式的文件中为 "~DELETED~"）
+    virtual uint64_t time() const = 0; // 数据源的时间戳，同一层中越大越新
+    virtual int level() const = 0; // 数据源所在的层数（跳表为 -1），层数小者更新
+    virtual uint64_t seq() const {return 0;} // 跳表中键值对的写入序号，与同一跳表中的范围删除比较新旧；sst 文件中为 0
+};
+
+// 多个内部迭代器的 k 路归并：按键升序输出，同一键只保留最新的版本，被范围删除标记删除的版本按删除标记输出
+// 内存占用只与数据源的个数有关，与键的覆盖区间无关
+class MergingIterator : public InternalIterator {
+private:
+    struct Greater {
+        bool operator()(const InternalIterator *a, const InternalIterator *b) const {
+            if (a->key() != b->key())
+                return a->key() > b->key();
+            if (a->level() != b->level())
+                return a->level() > b->level();
+            return a->time() < b->time();
+        }
+    };
+
+    std::vector<InternalIterator *> children;
+    std::priority_queue<InternalIterator *, std::vector<InternalIterator *>, Greater> heap;
+    RangeDeletions *range_dels; // 各数据源的范围删除标记，没有时为 nullptr
+
+    void Rebuild();
+
+public:
+    explicit MergingIterator(const std::vector<InternalIterator *> &children, RangeDeletions *range_dels = nullptr);
+    ~MergingIterator() override;
+
+    bool Valid() const override {return !heap.empty();}
+    void Seek(uint64_t target) override;
+    void Next() override;
+    uint64_t key() const override {return heap.top()->key();}
+    const std::string &value() const override {return heap.top()->value();}
+    ValueType type() const override {return Covered() ? TYPE_DELETION : heap.top()->type();}
+    uint64_t time() const override {return heap.top()->time();}
+    int level() const override {return heap.top()->level();}
+    uint64_t seq() const override {return heap.top()->seq();}
+    bool Covered() const; // 当前键的最新版本是否被更新的范围删除标记删除
+};
+
+// 对外的迭代器：在归并结果之上跳过被删除的键，并且不会越过构造时给定的上界
+// 迭代器存活期间固定构造时的版本，其中的文件不会被删除；落盘、compaction 与写入都可以照常进行
+class Iterator {
+private:
+    InternalIterator *iter;
+    uint64_t upper;
+    std::shared_ptr<const Version> version;
+
+    void SkipDeleted();
+
+public:
+    Iterator(InternalIterator *iter, uint64_t upper, std::shared_ptr<const Version> version);
+    ~Iterator();
+
+    bool Valid() const {return iter->Valid() && iter->key() <= upper;}
+    void Seek(uint64_t target);
+    void Next();
+    uint64_t key() const {return iter->key();}
+    const std::string &value() const {return iter->value();}
+};
@@ -1,21 +1,142 @@
 #include "kvstore.h"
 #include <string>
 #include <fstream>
-#include "MurmurHash3.h"
+#include "bloom.h"
 #include <cstdio>
 #include "string.h"
+#include <chrono>
+#include <algorithm>
+#include <set>
 
-KVStore::KVStore(const std::string &dir): KVStoreAPI(dir)
+// 函数功能：将 WAL 中的一条记录回放到跳表中
+static void Replay(SkipList &table, const LogRecord &record)
+{
+    if (record.type == TYPE_RANGE_DELETION) {
+        uint64_t end;
+        memcpy(&end, record.val.c_str(), sizeof(uint64_t));
+        table.DeleteRange(record.key, end);
+    } else {
+        table.Insert(record.key, record.val, record.type);
+    }
+}
+
+KVStore::KVStore(const std::string &dir): KVStore(dir, Options())
+{
+}
+
+KVStore::KVStore(const std::string &dir, const Options &options): KVStoreAPI(dir), options(options)
 {
     file = dir;
+    wal = nullptr;
+    imm_time = 0;
+    logging = false;
+    io_error = false;
+    file_seq = 1;
     time_max = 0;
-    level_max = -1; // -1 说明目前尚未有任何目录存在
+    stat_gets = 0;
+    stat_bloom_probes = 0;
+    stat_index_searches = 0;
+    stat_tables = 0;
+    table_cache = new TableCache(options.max_open_files, options.use_mmap);
+    block_cache = options.block_cache_size > 0 ? new BlockCache(options.block_cache_size) : nullptr;
+    row_cache = options.row_cache_size > 0 ? new RowCache(options.row_cache_size) : nullptr;
+
+    // 由 MANIFEST 恢复各层文件的元数据，此时不读取任何 sst 文件；旧版本留下的目录没有 MANIFEST，退回到扫描目录
+    utils::mkdir(file.c_str());
+    std::vector<sst_buf *> files;
+    uint64_t last_time, next_file_seq;
+    auto initial = std::make_shared<Version>();
+    if (Manifest::Recover(file, files, last_time, next_file_seq)) {
+        time_max = last_time;
+        file_seq = next_file_seq;
+        for (auto add : files) {
+            AttachCaches(add);
+            initial->Add(add);
+        }
+    } else {
+        LoadLegacy(*initial);
+    }
+    version = initial;
+
+    // 崩溃时尚未记入 MANIFEST 的文件（写了一半的落盘或 compaction 输出）以及已经删除但尚未移除的文件
+    RemoveObsoleteFiles();
+    manifest = new Manifest(file);
+    manifest->WriteSnapshot(*version, time_max, file_seq);
+
+    MemTable = std::make_shared<SkipList>();
+    scheduler = new Scheduler(options.flush_threads, options.compaction_threads, options.prefetch_threads);
 
-    head = new sst_buf;
-    head->next = nullptr; // 首先构造头结点
+    // 按查找顺序在后台预读各个文件的 Bloom Filter 与索引区，未预读到的文件在第一次访问时读入
+    for (int level = 0; level <= version->MaxLevel(); ++level) {
+        for (auto ptr : version->Files(level))
+            scheduler->SchedulePrefetch([ptr]() {ptr->Load();});
+    }
+
+    // 回放 WAL 恢复上次退出时尚未落盘的跳表内容
+    if (options.use_wal) {
+        std::vector<LogRecord> records;
+
+        // 上次退出时正在等待落盘的 ImmTable，直接写为 SSTable
+        std::string imm_path = file + "/wal.imm.log";
+        WriteAheadLog::ReadAll(imm_path, records);
+        if (!records.empty()) {
+            SkipList table;
+            for (auto &record : records)
+                Replay(table, record);
+            if (!WriteToDisk(table, ++time_max))
+                io_error = true;
+        }
+        if (!io_error)
+            utils::rmfile(imm_path.c_str());
 
-    // 从现有的全部SSTable中读入sst_buf至内存 (COMPACTION 注意要分层地读)
-    std::ifstream in;
+        // 回放的写入序列与当初完全一致，不会超过 2MB 的限制
+        std::string wal_path = file + "/wal.log";
+        records.clear();
+        WriteAheadLog::ReadAll(wal_path, records);
+        for (auto &record : records)
+            Replay(*MemTable, record);
+
+        wal = new WriteAheadLog(wal_path, options.wal_sync, options.wal_sync_interval);
+    }
+
+    // 上次退出时可能有尚未完成的下溢
+    std::lock_guard<std::mutex> lock(sst_mutex);
+    MaybeScheduleCompaction();
+}
+
+KVStore::~KVStore()
+{
+    // 将目前内存内容全部写入磁盘 SSTable，并等待所有后台任务完成，尚未开始的预读不再需要
+    scheduler->CancelPrefetch();
+    Flush();
+    {
+        // 仍被迭代器固定的输入文件不在 MANIFEST 中，下次打开时删除
+        std::lock_guard<std::mutex> lock(sst_mutex);
+        PurgeRetiredFiles();
+        for (auto ptr : retired)
+            ptr->Unref();
+        retired.clear();
+    }
+    delete scheduler;
+    delete manifest;
+
+    // 写盘出错时跳表中的内容没有全部落盘，保留 WAL 以便下次打开时恢复
+    if (wal) {
+        if (!io_error)
+            wal->Truncate();
+        delete wal;
+    }
+
+    // 将全部缓冲区以及跳表（自动）进行析构
+    version.reset();
+    delete table_cache;
+    delete block_cache;
+    delete row_cache;
+}
+
+// 函数功能：没有 MANIFEST 时（旧版本创建的目录），分层扫描目录读入全部 SSTable，并由文件名确定新文件的序号
+void KVStore::LoadLegacy(Version &initial) {
+    int level_max = -1; // -1 说明目前尚未有任何目录存在
 
     bool isEmpty; // 首先判断 level0 是否存在
     isEmpty = utils::dirExists(file + "/level0");
@@ -33,1095 +154,840 @@ KVStore::KVStore(const std::string &dir): KVStoreAPI(dir)
         std::string dirname = file + "/level" + std::to_string(level_max);
         utils::scanDir(dirname, all_files);
 
-        std::vector<std::string>::iterator Iter;
-        Iter = all_files.begin();
-
-        while (Iter != all_files.end()) { // 内层循环需要遍历一层中的所有文件
-            std::string level_no = std::to_string(level_max);
-            std::string filename = file + "/level" + level_no + "/" + *Iter;
-            in.open(filename, std::ios::binary|std::ios::in);
-
+        for (auto &name : all_files) { // 内层循环需要遍历一层中的所有文件
             auto *add = new sst_buf;
-
-            add->path = filename; // for compaction
-
-            in.read((char*)&(add->time), sizeof(uint64_t));
-            in.read((char*)&(add->num), sizeof(uint64_t));
-            in.read((char*)&(add->min), sizeof(uint64_t));
-            in.read((char*)&(add->max), sizeof(uint64_t));
-
-            in.read((char*)&(add->arr), sizeof(add->arr)); // 载入 Bloom Filter
-
-            add->key = new uint64_t [add->num];
-            add->offset = new uint32_t [add->num]; // 动态分配内存
-
-            for (int i=0; i<add->num; ++i) {
-                in.read((char*)&(add->key[i]), sizeof(uint64_t));
-                in.read((char*)&(add->offset[i]), sizeof(uint32_t));
+            add->path = dirname + "/" + name;
+            add->level = level_max;
+
+            // 残缺文件的数据仍然保存在输入文件或 WAL 中，直接丢弃
+            if (!add->Read()) {
+                utils::rmfile(add->path.c_str());
+                delete add;
+                continue;
             }
 
-            in.close();
-
-            // 将创建的结构体插入到链表的头部
-            add->next = head->next;
-            head->next = add;
+            // 文件名为 levelN_时间戳_序号.sst（level0 没有序号），新文件的序号从已有的最大序号之后开始
+            std::vector<std::string> res = split('_', name);
+            if (res.size() == 3 && (uint64_t) atoi(res[2].c_str()) >= file_seq)
+                file_seq = atoi(res[2].c_str()) + 1;
 
-            // 确定最大时间戳
+            // 将创建的结构体按层次顺序插入，并确定最大时间戳
+            AttachCaches(add);
+            initial.Add(add);
             if (add->time > time_max)
                 time_max = add->time;
-
-            Iter ++ ; // 开始读取下一个文件
         }
 
         // 读完本层的所有文件，开始判断下一层文件夹是否存在
-        std::string next_level = std::to_string(level_max + 1);
-        std::string next_dir = file + "/level" + next_level;
+        std::string next_dir = file + "/level" + std::to_string(level_max + 1);
         isEmpty = utils::dirExists(next_dir);
     }
 }
 
-KVStore::~KVStore()
-{
-    // 将目前内存内容全部写入磁盘 SSTable
-    WriteToDisk();
-
-    // 将链表以及跳表（自动）进行析构
-    sst_buf *del = head;
-    while (head != nullptr) {
-        head = head->next;
-        delete [] del->key;
-        delete [] del->offset;
-        delete del;
-        del = head;
+// 函数功能：令 add 经由表缓存打开、经由块缓存读取数据块，每个文件在块缓存中有唯一的序号，被删除的文件留下的数据块随 LRU 淘汰
+void KVStore::AttachCaches(sst_buf *add) {
+    add->cache = table_cache;
+    if (block_cache) {
+        add->block_cache = block_cache;
+        add->block_cache_id = block_cache->NewId();
     }
 }
 
-void KVStore::WriteToDisk() {
-
-    utils::mkdir((file + "/level0").c_str());
-
-    SKNode *travel = MemTable.head->forwards[0];
-    if (travel->type == SKNodeType::NIL)
-        return; // 说明这是一个空跳表，直接返回
-
-    // 将跳表的底层转换为 SSTable
-    auto *record = new sst_buf;
-    time_max++;
-    record->time = time_max;
-    record->num = 0;
-
-    while (true) {
-        if (record->num == 0)
-            record->min = travel->key;
-
-        record->num++;
-
-        if (travel->forwards[0]->type == SKNodeType::NIL)
-            record->max = travel->key;
-
-        travel = travel->forwards[0];
-
-        if (travel->type == SKNodeType::NIL)
-            break;
-    } // 可以首先获得键值对的数量，以及最大最小值
-
-    record->key = new uint64_t [record->num];
-    record->offset = new uint32_t [record->num]; // 动态分配内存
-
-    // 获得所有的键与值
-    int *str_len = new int [record->num];
-    travel = MemTable.head->forwards[0];
-    int i=0;
-    while (true) {
-        record->key[i] = travel->key;
-        str_len[i] = (int)(travel->val).length();
-
-        travel = travel->forwards[0];
-        i++;
-
-        if (travel->type == SKNodeType::NIL)
-            break;
+// 函数功能：删除各层目录中不属于当前 Version 的文件，只在打开时、后台任务开始之前调用
+void KVStore::RemoveObsoleteFiles() {
+    std::set<std::string> live;
+    for (int level = 0; level <= version->MaxLevel(); ++level) {
+        for (auto ptr : version->Files(level))
+            live.insert(ptr->path);
     }
 
-    uint32_t offset = 32 + 10240 + 12 * record->num; // 数据区的起始地址
-    // 获得字符串长度数组，并且设置所有的 offset 取值
-    for (int j=0; j<record->num; ++j) {
-        record->offset[j] = offset;
-        offset += str_len[j];
-    }
-    delete [] str_len;
-
-    // 引入哈希函数设置 Bloom Filter
-    for (int j=0; j < record->num; ++j) {
-        unsigned int hash[4] = {0};
-        MurmurHash3_x64_128(record->key + j, sizeof(uint64_t), 1, hash);
-        record->arr[hash[0] % 81920] = true;
-        record->arr[hash[1] % 81920] = true;
-        record->arr[hash[2] % 81920] = true;
-        record->arr[hash[3] % 81920] = true;
+    for (int level = 0; utils::dirExists(file + "/level" + std::to_string(level)); ++level) {
+        std::string dirname = file + "/level" + std::to_string(level);
+        std::vector<std::string> all_files;
+        utils::scanDir(dirname, all_files);
+        for (auto &name : all_files) {
+            std::string path = dirname + "/" + name;
+            if (!live.count(path))
+                utils::rmfile(path.c_str());
+        }
     }
+}
 
-    // 将 SSTable 写入 .sst 文件，并设置 offset
-    std::string num = std::to_string(record->time-1);
-    std::ofstream out(file + "/level0/level0_" + num + ".sst", std::ios::out|std::ios::app|std::ios::binary);
-
-    record->path = file + "/level0/level0_" + num + ".sst";
-
-    out.write((char*)&record->time, sizeof(uint64_t));
-    out.write((char*)&record->num, sizeof(uint64_t));
-    out.write((char*)&record->min, sizeof(uint64_t));
-    out.write((char*)&record->max, sizeof(uint64_t));
-
-    out.write((char*)&record->arr, sizeof(record->arr));
+// 函数参数 table: 需要落盘的跳表，落盘期间不会被修改
+// 函数参数 timeStamp: 新 SSTable 的时间戳
+// 函数返回值 bool: 写 sst 文件或 MANIFEST 失败时返回 false，此时没有修改 Version，跳表中的内容仍然在 WAL 中
+// 函数功能：将跳表的底层转换为 level0 的 SSTable，写盘时不持有任何锁，最后将其链入缓存
+bool KVStore::WriteToDisk(const SkipList &table, uint64_t timeStamp) {
 
-    for (int j=0; j<record->num; ++j) {
-        out.write((char*)&record->key[j], sizeof(uint64_t));
-        out.write((char*)&record->offset[j], sizeof(uint32_t));
-    }
+    utils::mkdir((file + "/level0").c_str());
 
-    travel = MemTable.head->forwards[0];
-    while (true) {
-        out.write((travel->val).c_str(), (int)(travel->val).length());
+    table.WaitForWriters(); // 切换之前已经分配序号的写者可能仍在插入
+    if (table.Empty())
+        return true; // 说明这是一个空跳表，直接返回
 
-        travel = travel->forwards[0];
-        if (travel->type == SKNodeType::NIL)
-            break;
+    // 被同一跳表中更晚的范围删除覆盖的键值对不再写出，文件中的范围删除标记因此只删除更旧的文件中的键值对
+    std::vector<RangeTombstone> fragments;
+    table.RangeFragments(fragments);
+    SSTableWriter writer(timeStamp, TableOptions(!fragments.empty()));
+    std::string val;
+    for (SKNode *travel = table.head->Next(0); travel->type != SKNodeType::NIL; travel = travel->Next(0)) {
+        const SKValue *v = travel->Value();
+        if (table.Covered(travel, v))
+            continue;
+        val.assign(v->Data(), v->len);
+        writer.Add(travel->key, val, v->type);
     }
+    for (auto &t : fragments)
+        writer.AddRange(t.begin, t.end);
 
-    out.close();
-
-    // 将磁盘中该文件记入缓存
-    record->next = head->next;
-    head->next = record;
+    // 将 SSTable 写入 .sst 文件，注意文件名与时间戳相差 1
+    std::string num = std::to_string(timeStamp-1);
+    sst_buf *record = writer.Finish(file + "/level0/level0_" + num + ".sst");
+    if (record == nullptr)
+        return false;
+    AttachCaches(record);
 
-    // 将跳表的内容清零
-    MemTable.CleanDataLength();
-    SKNode *del = MemTable.head->forwards[0];
-    while (del->type != SKNodeType::NIL) {
-        SKNode *tmp = del;
-        del = del->forwards[0];
-        delete tmp;
+    // SSTable 持久化之后才能记入 MANIFEST，WAL 中的记录才可以被丢弃
+    if (utils::syncFile(record->path.c_str()) != 0 || utils::syncFile((file + "/level0").c_str()) != 0) {
+        utils::rmfile(record->path.c_str());
+        delete record;
+        return false;
     }
 
-    for (int j = 0; j < MAX_LEVEL; ++j)
-    {
-        MemTable.head->forwards[j] = del;
+    // 将磁盘中该文件记入 MANIFEST 与缓存，level0 中新文件排在最前面
+    // MANIFEST 写入失败时记录可能已经生效，保留文件，下次打开时按 MANIFEST 的内容决定是否删除
+    std::lock_guard<std::mutex> lock(sst_mutex);
+    VersionEdit edit;
+    edit.added.push_back(record);
+    edit.last_time = timeStamp;
+    edit.next_file_seq = file_seq;
+    if (!manifest->Append(edit)) {
+        delete record;
+        return false;
     }
-
-    // 先将所有的文件放入 level0, 接下来再调用 compaction handler 进行分层归并处理
-    bool flag = IsLevelFull("level0");
-    if (flag)
-        compaction();
+    auto next = std::make_shared<Version>(*version);
+    next->Add(record);
+    InstallVersion(next);
+    return true;
 }
 
-// 函数参数 path: 磁盘上文件的路径名
-// 函数返回值 sst_buf* : 磁盘文件对应缓冲区结构体的指针
-// 函数功能：将目标结构体从链表中取下来
-sst_buf* KVStore::GetBuffer(const std::string &path) {
-    sst_buf* search = head->next;
-    sst_buf* del = head;
-    while (search->path != path) {
-        del = search;
-        search = del->next;
-    }
-    del->next = search->next;
-    search->next = nullptr;
-    return search;
+// 调用者持有 sst_mutex：以 next 替换当前版本，已经取得旧版本的读者继续使用旧版本中的文件
+void KVStore::InstallVersion(std::shared_ptr<Version> next) {
+    std::atomic_store(&version, std::shared_ptr<const Version>(std::move(next)));
 }
 
-// 函数参数 path: 磁盘上文件的路径名
-// 函数参数 key; 函数返回值 string: 由某一缓冲区结构体键值，得到对应磁盘文件数据区字符串值
-std::string KVStore::GetString(const std::string &path, uint64_t key) {
-
-    std::ifstream in;
-    in.open(path, std::ios::binary|std::ios::in);
-
-    auto *add = new sst_buf;
-
-    in.read((char*)&(add->time), sizeof(uint64_t));
-    in.read((char*)&(add->num), sizeof(uint64_t));
-    in.read((char*)&(add->min), sizeof(uint64_t));
-    in.read((char*)&(add->max), sizeof(uint64_t));
-
-    in.read((char*)&(add->arr), sizeof(add->arr));
+// 函数返回值 shared_ptr<const Version>: 当前版本，持有期间其中的文件不会被删除
+std::shared_ptr<const Version> KVStore::CurrentVersion() const {
+    return std::atomic_load(&version);
+}
 
-    add->key = new uint64_t [add->num];
-    add->offset = new uint32_t [add->num]; // 动态分配内存后记得释放堆空间
+// 调用者持有 sst_mutex：删除不再被任何版本引用的 compaction 输入文件，仍被读者固定的留到下次
+void KVStore::PurgeRetiredFiles() {
+    auto unused = std::partition(retired.begin(), retired.end(), [](const sst_buf *ptr) {
+        return ptr->refs > 1;
+    });
+    if (unused == retired.end())
+        return;
 
-    uint64_t dest_index = -1; // 确定目标键值的脚标，-1 代表没有找到目标键值，返回空字符串
-    for (int i=0; i<add->num; ++i) {
-        in.read((char*)&(add->key[i]), sizeof(uint64_t));
-        in.read((char*)&(add->offset[i]), sizeof(uint32_t));
-        if (add->key[i] == key) dest_index = i;
+    scheduler->WaitPrefetch();
+    for (auto it = unused; it != retired.end(); ++it) {
+        sst_buf *ptr = *it;
+        table_cache->Evict(ptr->path);
+        utils::rmfile(ptr->path.c_str());
+        ptr->Unref();
     }
+    retired.erase(unused, retired.end());
+}
 
-    if (dest_index == -1) {
+// 函数返回值 Options: 新文件的写出选项；逐键索引的格式没有标志位，含有范围删除标记的文件改用默认大小的数据块
+Options KVStore::TableOptions(bool range_deletions) const {
+    Options table_options = options;
+    if (range_deletions && table_options.block_size == 0)
+        table_options.block_size = Options().block_size;
+    return table_options;
+}
 
-        in.close();
+// 调用者持有 mutex，ImmTable 为空且没有 leader 正在追加 WAL：将写满的 MemTable 移入 ImmTable，并唤醒后台线程
+void KVStore::SwitchMemTable() {
+    ImmTable = MemTable;
+    imm_time = ++time_max;
+    MemTable = std::make_shared<SkipList>();
+
+    // 旧的日志随 ImmTable 一起等待落盘，新的写入记录到新的日志中
+    if (wal) {
+        delete wal;
+        std::rename((file + "/wal.log").c_str(), (file + "/wal.imm.log").c_str());
+        wal = new WriteAheadLog(file + "/wal.log", options.wal_sync, options.wal_sync_interval);
+    }
 
-        delete [] add->key;
-        delete [] add->offset;
-        delete add;
+    scheduler->ScheduleFlush([this]() {BackgroundFlush();});
+}
 
-        return "";
+// 后台落盘任务：将 ImmTable 写为 SSTable 后清空 ImmTable，使前台可以再次切换跳表
+void KVStore::BackgroundFlush() {
+    std::shared_ptr<SkipList> table;
+    uint64_t timeStamp;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        table = ImmTable;
+        timeStamp = imm_time;
     }
-    else {
 
-        in.seekg(0, std::ifstream::end); // 将文件指针指向输入流的末尾
-        long long length = in.tellg(); // 获得文件总的字节数
-        in.seekg(0, std::ifstream::beg); // 回到输入流的头部
+    // 落盘失败时 ImmTable 仍可读，它的 WAL 保留到下次打开时再落盘；等待 ImmTable 清空的写者随之失败
+    bool ok = WriteToDisk(*table, timeStamp);
+    if (ok && wal)
+        utils::rmfile((file + "/wal.imm.log").c_str());
 
-        uint32_t destOffset = add->offset[dest_index];
-        uint32_t destLength;
-        if (dest_index == add->num - 1)
-            destLength = length - destOffset;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (ok)
+            ImmTable.reset();
         else
-            destLength = add->offset[dest_index + 1] - destOffset;
-
-        in.seekg(destOffset); // 对文件指针进行目标量的偏移
-        char *str_val = new char[destLength + 1];
-        in.read(str_val, destLength);
-        str_val[destLength] = '\0';
-        std::string val = str_val;
-        delete [] str_val;
-
-        in.close();
+            io_error = true;
+        cv.notify_all();
+    }
+    if (!ok)
+        return;
 
-        delete [] add->key;
-        delete [] add->offset;
-        delete add;
+    // 先将所有的文件放入 level0, 接下来交给 compaction 线程池进行分层归并处理
+    std::lock_guard<std::mutex> lock(sst_mutex);
+    MaybeScheduleCompaction();
+}
 
-        return val;
+void KVStore::Flush() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while ((ImmTable && !io_error) || logging)
+            cv.wait(lock);
+        if (!io_error && !MemTable->Empty())
+            SwitchMemTable();
     }
+    scheduler->WaitIdle();
 }
 
-// 默认是最开始 level0 调用的 compaction, 向 level1 进行下溢合并（不含参）, 该函数调用含参 compaction
-void KVStore::compaction() {
-
-    // 首先判断 level1 是否存在（若存在一定可以说明该层有若干文件）
-    bool level1_exist = utils::dirExists(file + "/level1");
-
-    std::vector<std::string> level0_files;
-    utils::scanDir(file + "/level0", level0_files);
-    std::vector<std::string>::iterator Iter;
-    Iter = level0_files.begin();
-
-    sst_buf* ptr1 = GetBuffer(file + "/level0/" + *Iter);
-    Iter ++ ;
-    sst_buf* ptr2 = GetBuffer(file + "/level0/" + *Iter);
-    Iter ++ ;
-    sst_buf* ptr3 = GetBuffer(file + "/level0/" + *Iter);
-
-    uint64_t key_min = ptr1->min;
-    uint64_t key_max = ptr1->max;
-    uint64_t new_time = ptr1->time;
-    if (ptr2->min < key_min) key_min = ptr2->min;
-    if (ptr3->min < key_min) key_min = ptr3->min;
-    if (ptr2->max > key_max) key_max = ptr2->max;
-    if (ptr3->max > key_max) key_max = ptr3->max; // 获取 level0 的键值覆盖区间
-    if (ptr2->time > new_time) new_time = ptr2->time;
-    if (ptr3->time > new_time) new_time = ptr3->time; // 获取合并文件的最大时间戳作为新的时间戳
-
-    // 将 level0 三份文件进行归并排序（处理重复键值），按 2MB 划分为新的 level1 文件（不可能继续下溢）
-    std::list<std::pair<uint64_t, std::string>> list;
-
-    for (uint64_t i=0; i<(key_max - key_min + 1); ++i) {
-        std::pair<uint64_t, std::string> insert (key_min + i, "");
-        list.push_back(insert);
-    } // 初始化，将所有键的值设为空的 ""
-
-    auto *time_record = new uint64_t [key_max - key_min + 1];
-    for (uint64_t i=0; i<key_max - key_min + 1; ++i)
-        time_record[i] = 0; //记录当前时间戳的数组，并且全部初始化为 0
-
-    // 将三个文件中的键值对全部存入 list 中保存
-
-    std::ifstream in;
-    in.open(ptr1->path, std::ios::binary|std::ios::in);
-
-    in.seekg(0, std::ifstream::end); // 将文件指针指向输入流的末尾
-    long long length = in.tellg(); // 获得文件总的字节数
-    in.seekg(0, std::ifstream::beg); // 回到输入流的头部
-
-    auto *add = new sst_buf;
-
-    in.read((char*)&(add->time), sizeof(uint64_t));
-    in.read((char*)&(add->num), sizeof(uint64_t));
-    in.read((char*)&(add->min), sizeof(uint64_t));
-    in.read((char*)&(add->max), sizeof(uint64_t));
-
-    in.read((char*)&(add->arr), sizeof(add->arr));
+WriteStats KVStore::GetWriteStats() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return write_stats;
+}
 
-    add->key = new uint64_t [add->num];
-    add->offset = new uint32_t [add->num]; // 动态分配内存后记得释放堆空间
+CompactionStats KVStore::GetCompactionStats() {
+    std::lock_guard<std::mutex> lock(sst_mutex);
+    return stats;
+}
 
-    for (int j=0; j < add->num; ++j) {
-        in.read((char*)&(add->key[j]), sizeof(uint64_t));
-        in.read((char*)&(add->offset[j]), sizeof(uint32_t));
+ReadStats KVStore::GetReadStats() {
+    ReadStats result;
+    result.gets = stat_gets;
+    result.bloom_probes = stat_bloom_probes;
+    result.index_searches = stat_index_searches;
+    result.tables = stat_tables;
+    result.table_cache_hits = table_cache->Hits();
+    result.table_cache_misses = table_cache->Misses();
+    if (block_cache) {
+        result.block_cache_hits = block_cache->Hits();
+        result.block_cache_misses = block_cache->Misses();
+        result.block_cache_bytes = block_cache->Usage();
     }
+    if (row_cache) {
+        result.row_cache_hits = row_cache->Hits();
+        result.row_cache_misses = row_cache->Misses();
+    }
+    return result;
+}
 
-    for (uint64_t i=0; i<ptr1->num; ++i) {
-        uint64_t key = ptr1->key[i];
-
-        uint64_t dest_index = i;
-        uint32_t destOffset = add->offset[dest_index];
-        uint32_t destLength;
-        if (dest_index == add->num - 1)
-            destLength = length - destOffset;
-        else
-            destLength = add->offset[dest_index + 1] - destOffset;
-
-        char *str_val = new char[destLength + 1];
-        in.read(str_val, destLength);
-        str_val[destLength] = '\0';
-        std::string val = str_val;
-        delete [] str_val;
-
-        uint64_t time_index = key - key_min;
-        if (ptr1->time > time_record[time_index]) {
-            update_list(key, val, key_min, key_max, list);
-            time_record[time_index] = ptr1->time;
+// 函数返回值 uint64_t: 全部 sst 文件的索引区载入内存后占用的字节数，不含 Bloom Filter
+uint64_t KVStore::GetIndexMemory() {
+    std::shared_ptr<const Version> current = CurrentVersion();
+    uint64_t total = 0;
+    for (int level = 0; level <= current->MaxLevel(); ++level) {
+        for (auto ptr : current->Files(level)) {
+            ptr->Load();
+            total += ptr->IndexMemory();
         }
     }
+    return total;
+}
 
-    delete [] add->key;
-    delete [] add->offset;
-    delete add;
-
-    in.close();
-
-// ==========================================================================================
-
-    in.open(ptr2->path, std::ios::binary|std::ios::in);
-
-    in.seekg(0, std::ifstream::end); // 将文件指针指向输入流的末尾
-    length = in.tellg(); // 获得文件总的字节数
-    in.seekg(0, std::ifstream::beg); // 回到输入流的头部
-
-    add = new sst_buf;
-
-    in.read((char*)&(add->time), sizeof(uint64_t));
-    in.read((char*)&(add->num), sizeof(uint64_t));
-    in.read((char*)&(add->min), sizeof(uint64_t));
-    in.read((char*)&(add->max), sizeof(uint64_t));
-
-    in.read((char*)&(add->arr), sizeof(add->arr));
+// 函数参数 path: 磁盘上文件的路径名
+// 函数参数 key; 函数返回值 string: 由某一缓冲区结构体键值，得到对应磁盘文件数据区字符串值
+std::string KVStore::GetString(const std::string &path, uint64_t key) {
+    sst_buf table;
+    table.path = path;
+    if (!table.Read())
+        return "";
 
-    add->key = new uint64_t [add->num];
-    add->offset = new uint32_t [add->num]; // 动态分配内存后记得释放堆空间
+    SSTableIterator iter(&table);
+    iter.Seek(key);
+    if (!iter.Valid() || iter.key() != key || iter.type() == TYPE_DELETION)
+        return ""; // 没有找到目标键值，返回空字符串
+    return iter.value();
+}
 
-    for (int j=0; j < add->num; ++j) {
-        in.read((char*)&(add->key[j]), sizeof(uint64_t));
-        in.read((char*)&(add->offset[j]), sizeof(uint32_t));
+// 函数功能：计算 level 层的得分，即尚未参与 compaction 的文件个数与该层文件数上限之比，超过 1 才需要下溢
+double KVStore::LevelScore(int level) {
+    int cur_sst_num = 0;
+    for (auto ptr : version->Files(level)) {
+        if (!ptr->being_compacted)
+            cur_sst_num ++ ;
     }
+    int max_sst_num = 1 << (level + 1); // 最大文件数目为 2 的幂次方
+    return (double) cur_sst_num / max_sst_num;
+}
 
-    for (uint64_t i=0; i<ptr2->num; ++i) {
-        uint64_t key = ptr2->key[i];
-
-        uint64_t dest_index = i;
-        uint32_t destOffset = add->offset[dest_index];
-        uint32_t destLength;
-        if (dest_index == add->num - 1)
-            destLength = length - destOffset;
+// 函数功能：为 level 层选定一次 compaction 的输入并标记，与正在进行的 compaction 冲突时返回 nullptr
+CompactionJob *KVStore::PickCompaction(int level) {
+    std::vector<sst_buf *> candidates; // 该层尚未参与 compaction 的文件
+    bool busy = false;
+    for (auto ptr : version->Files(level)) {
+        if (ptr->being_compacted)
+            busy = true;
         else
-            destLength = add->offset[dest_index + 1] - destOffset;
-
-        char *str_val = new char[destLength + 1];
-        in.read(str_val, destLength);
-        str_val[destLength] = '\0';
-        std::string val = str_val;
-        delete [] str_val;
-
-        uint64_t time_index = key - key_min;
-        if (ptr2->time > time_record[time_index]) {
-            update_list(key, val, key_min, key_max, list);
-            time_record[time_index] = ptr2->time;
-        }
+            candidates.push_back(ptr);
     }
 
-    delete [] add->key;
-    delete [] add->offset;
-    delete add;
-
-    in.close();
-
-// =============================================================================================
+    uint64_t max_sst_num = 1 << (level + 1);
+    if (candidates.size() <= max_sst_num)
+        return nullptr;
 
-    in.open(ptr3->path, std::ios::binary|std::ios::in);
+    auto *job = new CompactionJob;
+    job->level = level;
 
-    in.seekg(0, std::ifstream::end); // 将文件指针指向输入流的末尾
-    length = in.tellg(); // 获得文件总的字节数
-    in.seekg(0, std::ifstream::beg); // 回到输入流的头部
-
-    add = new sst_buf;
-
-    in.read((char*)&(add->time), sizeof(uint64_t));
-    in.read((char*)&(add->num), sizeof(uint64_t));
-    in.read((char*)&(add->min), sizeof(uint64_t));
-    in.read((char*)&(add->max), sizeof(uint64_t));
-
-    in.read((char*)&(add->arr), sizeof(add->arr));
-
-    add->key = new uint64_t [add->num];
-    add->offset = new uint32_t [add->num]; // 动态分配内存后记得释放堆空间
-
-    for (int j=0; j < add->num; ++j) {
-        in.read((char*)&(add->key[j]), sizeof(uint64_t));
-        in.read((char*)&(add->offset[j]), sizeof(uint32_t));
+    if (level == 0) {
+        // level0 的文件之间键值区间可能重叠，因此全部参与合并，并且同一时刻只能有一个 level0 的 compaction
+        if (busy) {
+            delete job;
+            return nullptr;
+        }
+        job->upper = candidates;
+    } else {
+        // 确定参与合并的超额文件（时间戳小、键值范围小）
+        std::sort(candidates.begin(), candidates.end(), [](const sst_buf *a, const sst_buf *b) {
+            if (a->time != b->time)
+                return a->time < b->time;
+            return a->min < b->min;
+        });
+        job->upper.assign(candidates.begin(), candidates.begin() + (candidates.size() - max_sst_num));
     }
 
-    for (uint64_t i=0; i<ptr3->num; ++i) {
-        uint64_t key = ptr3->key[i];
+    job->key_min = job->upper[0]->min;
+    job->key_max = job->upper[0]->max;
+    job->time = job->upper[0]->time;
+    for (auto ptr : job->upper) {
+        if (ptr->min < job->key_min) job->key_min = ptr->min;
+        if (ptr->max > job->key_max) job->key_max = ptr->max; // 获取当前层溢出文件的键值覆盖区间
+        if (ptr->time > job->time) job->time = ptr->time; // 获取合并文件的最大时间戳作为新的时间戳
+    }
 
-        uint64_t dest_index = i;
-        uint32_t destOffset = add->offset[dest_index];
-        uint32_t destLength;
-        if (dest_index == add->num - 1)
-            destLength = length - destOffset;
-        else
-            destLength = add->offset[dest_index + 1] - destOffset;
-
-        char *str_val = new char[destLength + 1];
-        in.read(str_val, destLength);
-        str_val[destLength] = '\0';
-        std::string val = str_val;
-        delete [] str_val;
-
-        uint64_t time_index = key - key_min;
-        if (ptr3->time > time_record[time_index]) {
-            update_list(key, val, key_min, key_max, list);
-            time_record[time_index] = ptr3->time;
+    // 在 level + 1 中寻找与该区间有交集的所有 sst 文件，合在一起进行归并排序
+    uint64_t key_min = job->key_min;
+    uint64_t key_max = job->key_max;
+    for (auto ptr : version->Files(level + 1)) {
+        if (ptr->max < key_min || ptr->min > key_max)
+            continue;
+        if (ptr->being_compacted) { // 该文件正在下溢到更深的层
+            delete job;
+            return nullptr;
         }
+        job->lower.push_back(ptr);
+        if (ptr->min < job->key_min) job->key_min = ptr->min;
+        if (ptr->max > job->key_max) job->key_max = ptr->max;
+        if (ptr->time > job->time) job->time = ptr->time;
     }
 
-    delete [] add->key;
-    delete [] add->offset;
-    delete add;
-
-    in.close();
-
-// ===============================================================================================
-
-    // 进行动态分配空间的释放以及原文件的删除
-    utils::rmfile(ptr1->path.c_str());
-    utils::rmfile(ptr2->path.c_str());
-    utils::rmfile(ptr3->path.c_str());
-
-    delete [] ptr1->key;
-    delete [] ptr1->offset;
-    delete ptr1;
-
-    delete [] ptr2->key;
-    delete [] ptr2->offset;
-    delete ptr2;
-
-    delete [] ptr3->key;
-    delete [] ptr3->offset;
-    delete ptr3;
-
-    // case 1: 如果不存在 -> 获取 level0 的键值覆盖区间
-    if (!level1_exist) {
-        delete [] time_record;
-
-        // 按 2MB 划分为新的 level1 文件（不可能继续下溢）, 更新缓存中的链表（新时间戳取 max -> 注意对于文件的重命名）
-        utils::mkdir((file + "/level1").c_str());
-        split(list, 1, new_time);
-        return;
+    // 输出到同一层的 compaction 之间键值区间不能重叠，否则 level + 1 层的文件会互相覆盖
+    for (auto other : running) {
+        if (other->level == level && other->key_min <= job->key_max && other->key_max >= job->key_min) {
+            delete job;
+            return nullptr;
+        }
     }
 
-    // case 2: 如果存在 -> level0 的文件全部有用信息已经存储至 list 中，level1 中的部分文件同样需要类似的 update 处理
-    if (level1_exist) {
-        // 在 level1 中寻找与该区间有交集的所有 sst 文件，合在一起进行归并排序
-        expansion(list, new_time, 1, time_record);
-        delete [] time_record;
-        split(list, 1, new_time);
-
-        // 判断 level1 是否会触发新的下溢
-        bool flag = IsLevelFull("level1");
-
-        if (!flag)
-            return;
-        else // 如果继续下溢，那么递归地调用 compaction 携参函数
-            compaction(1);
+    // 更深的层只会由 level + 1 及以下的 compaction 写入，而 level + 1 中覆盖这些键的文件都已是本次的输入，
+    // 此时记下的区间在本次 compaction 完成之前不会出现新的键
+    for (int deeper = level + 2; deeper <= version->MaxLevel(); ++deeper) {
+        for (auto ptr : version->Files(deeper)) {
+            if (ptr->max >= job->key_min && ptr->min <= job->key_max)
+                job->deeper.emplace_back(ptr->min, ptr->max);
+        }
     }
+    std::sort(job->deeper.begin(), job->deeper.end());
+    std::vector<std::pair<uint64_t, uint64_t> > merged;
+    for (auto &range : job->deeper) {
+        if (!merged.empty() && range.first <= merged.back().second)
+            merged.back().second = std::max(merged.back().second, range.second);
+        else
+            merged.push_back(range);
+    }
+    job->deeper.swap(merged);
+
+    for (auto ptr : job->upper)
+        ptr->being_compacted = true;
+    for (auto ptr : job->lower)
+        ptr->being_compacted = true;
+    running.push_back(job);
+    return job;
 }
 
-// 函数功能：根据已有的键值对 list, 在 cur_level 中找到有交集的 sst 文件并进行相关变量的更新或删除
-void KVStore::expansion(std::list<std::pair<uint64_t, std::string>> &list, uint64_t &timeStamp, int cur_level,
-                        uint64_t *time_record) {
-    // 获得当前 list 中键值的取值范围(max/min)
-    uint64_t key_max = list.back().first;
-    uint64_t key_min = list.front().first;
-
-    std::vector<std::string> all_files;
-    utils::scanDir(file + "/level" + std::to_string(cur_level), all_files);
-    std::vector<std::string>::iterator Iter;
-    Iter = all_files.begin();
-
-    while (Iter != all_files.end()) { // 每一层循环处理当前层的一个文件
-
-        // 首先判断该文件是否与目标范围有交集，读取文件键值 min/max
-        sst_buf* ptr = GetBuffer(file + "/level" + std::to_string(cur_level) + "/" + *Iter);
-        uint64_t file_min = ptr->min;
-        uint64_t file_max = ptr->max;
-
-        int shadow_type = 0; // 1: left; 2: middle; 3: right; 4: cover.
-        if ((file_min < key_min) && (file_max >= key_min) && (file_max <= key_max)) shadow_type = 1;
-        if ((file_min >= key_min) && (file_max <= key_max)) shadow_type = 2;
-        if ((file_min >= key_min) && (file_min <= key_max) && (file_max > key_max)) shadow_type = 3;
-        if ((file_min < key_min) && (file_max > key_max)) shadow_type = 4;
-
-        if (!shadow_type) { // 将堆中取出的结构体重新放回
-            ptr->next = head->next;
-            head->next = ptr;
-            Iter ++; // 如果没有交集，可以直接跳过当前层的循环
-            continue;
+// 函数功能：按得分从高到低为各层选定 compaction 并交给后台线程池，直到没有可以并发执行的 compaction
+void KVStore::MaybeScheduleCompaction() {
+    while (!io_error) {
+        std::vector<std::pair<double, int> > scores;
+        for (int level = 0; level <= version->MaxLevel(); ++level) {
+            double score = LevelScore(level);
+            if (score > 1)
+                scores.emplace_back(score, level);
         }
-
-        // 找到所有文件对应的最大时间戳作为最终合并后的时间戳
-        if (ptr->time > timeStamp)
-            timeStamp = ptr->time;
-
-        if (shadow_type == 1) {
-            // 首先将链表的缺失部分补全
-            for (uint64_t i=key_min-1; i>=file_min; i--) {
-                std::pair<uint64_t, std::string> insert (i, "");
-                list.push_front(insert);
-                if (i == 0) break;
+        std::sort(scores.begin(), scores.end(), std::greater<std::pair<double, int> >());
+
+        CompactionJob *job = nullptr;
+        double score = 0;
+        for (auto &item : scores) {
+            job = PickCompaction(item.second);
+            if (job) {
+                score = item.first;
+                break;
             }
         }
 
-        if (shadow_type == 3) {
-            // 首先将链表的缺失部分补全
-            for (uint64_t i=key_max+1; i<=file_max; i++) {
-                std::pair<uint64_t, std::string> insert (i, "");
-                list.push_back(insert);
-            }
-        }
+        if (!job)
+            return;
 
-        if (shadow_type == 4) {
-            // 首先将链表的缺失部分补全
-            for (uint64_t i=key_min-1; i>=file_min; i--) {
-                std::pair<uint64_t, std::string> insert (i, "");
-                list.push_front(insert);
-                if (i == 0) break;
-            }
-            for (uint64_t i=key_max+1; i<=file_max; i++) {
-                std::pair<uint64_t, std::string> insert (i, "");
-                list.push_back(insert);
-            }
-        }
+        scheduler->ScheduleCompaction([this, job]() {RunCompaction(job);}, (int) (score * 100));
+    }
+}
 
-        std::ifstream in;
-        in.open(ptr->path, std::ios::binary|std::ios::in);
+// 函数功能：在后台线程中执行一次 compaction，归并期间不持有锁，完成后原子地替换输入文件
+void KVStore::RunCompaction(CompactionJob *job) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    utils::mkdir((file + "/level" + std::to_string(job->level + 1)).c_str());
+
+    // 输入文件已经被标记，不会被其他 compaction 修改或删除
+    std::vector<sst_buf *> outputs;
+    bool ok = split(job, outputs);
+    for (auto add : outputs)
+        ok = utils::syncFile(add->path.c_str()) == 0 && ok;
+    ok = utils::syncFile((file + "/level" + std::to_string(job->level + 1)).c_str()) == 0 && ok;
+
+    std::lock_guard<std::mutex> lock(sst_mutex);
+
+    // 新文件持久化之后，用一条记录原子地完成替换：崩溃发生在此之前时新文件会在重新打开时被删除，之后则删除旧文件
+    VersionEdit edit;
+    edit.added = outputs;
+    edit.deleted = job->upper;
+    edit.deleted.insert(edit.deleted.end(), job->lower.begin(), job->lower.end());
+    edit.last_time = job->time;
+    edit.next_file_seq = file_seq;
+    bool logged = ok && manifest->Append(edit);
+
+    // 写输出文件或 MANIFEST 失败：输入文件原样保留在当前版本中；输出文件只在确定没有记入 MANIFEST 时删除，
+    // MANIFEST 写入失败时记录可能已经生效，输入与输出文件都留给下次打开时按 MANIFEST 的内容处理
+    if (!logged) {
+        for (auto add : outputs) {
+            if (!ok)
+                utils::rmfile(add->path.c_str());
+            delete add;
+        }
+        for (auto ptr : job->upper)
+            ptr->being_compacted = false;
+        for (auto ptr : job->lower)
+            ptr->being_compacted = false;
+        running.erase(std::find(running.begin(), running.end(), job));
+        delete job;
+        io_error = true;
+        return;
+    }
 
-        in.seekg(0, std::ifstream::end); // 将文件指针指向输入流的末尾
-        long long length = in.tellg(); // 获得文件总的字节数
-        in.seekg(0, std::ifstream::beg); // 回到输入流的头部
+    // 先将原文件取下，再放入新文件，保持 level + 1 层的文件互不重叠；新版本整体替换当前版本
+    auto next = std::make_shared<Version>(*version);
+    for (auto ptr : job->upper)
+        next->Remove(ptr);
+    for (auto ptr : job->lower)
+        next->Remove(ptr);
+    for (auto add : outputs)
+        next->Add(add);
+
+    // 输入文件可能仍在读者固定的旧版本中，替换之前先取得引用，不再被任何版本引用之后才删除
+    RetireInputs(job->upper);
+    RetireInputs(job->lower);
+    InstallVersion(next);
+    PurgeRetiredFiles();
+
+    running.erase(std::find(running.begin(), running.end(), job));
+
+    stats.count ++ ;
+    stats.bytes_read += job->bytes_read;
+    stats.bytes_written += job->bytes_written;
+    stats.micros += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+    stats.entries_dropped += job->entries_dropped;
+    stats.tombstones_dropped += job->tombstones_dropped;
+    delete job;
+
+    // 本次 compaction 可能使 level + 1 继续下溢，或者解除了与其他 compaction 的冲突
+    MaybeScheduleCompaction();
+}
 
-        auto *add = new sst_buf;
+// 函数参数 job: 已经选定输入的 compaction
+// 函数参数 outputs: 新产生的文件对应的缓冲区结构体（尚未链入链表）
+// 函数返回值 bool: 某个输出文件写入失败时返回 false，此时 outputs 中只有此前成功写出的文件
+// 函数功能：对所有输入文件做多路归并，边归并边按 2MB 产生 sst 文件存储在磁盘上
+bool KVStore::split(CompactionJob *job, std::vector<sst_buf *> &outputs) {
 
-        in.read((char*)&(add->time), sizeof(uint64_t));
-        in.read((char*)&(add->num), sizeof(uint64_t));
-        in.read((char*)&(add->min), sizeof(uint64_t));
-        in.read((char*)&(add->max), sizeof(uint64_t));
+    int level = job->level + 1;
 
-        in.read((char*)&(add->arr), sizeof(add->arr));
+    std::vector<InternalIterator *> children;
+    auto *range_dels = new RangeDeletions;
+    for (auto ptr : job->upper) {
+        children.push_back(new SSTableIterator(ptr, false));
+        job->bytes_read += ptr->MetaSize();
+        range_dels->Add(ptr->level, ptr->time, ptr->range_tombstones);
+    }
+    for (auto ptr : job->lower) {
+        children.push_back(new SSTableIterator(ptr, false));
+        job->bytes_read += ptr->MetaSize();
+        range_dels->Add(ptr->level, ptr->time, ptr->range_tombstones);
+    }
 
-        add->key = new uint64_t [add->num];
-        add->offset = new uint32_t [add->num]; // 动态分配内存后记得释放堆空间
+    uint64_t entries = 0; // 输入的键值对总数，与输出的键值对个数之差即为被遮盖或删除的版本
+    for (auto ptr : job->upper)
+        entries += ptr->num;
+    for (auto ptr : job->lower)
+        entries += ptr->num;
+
+    // 被覆盖的键值对在归并时丢弃，此后范围删除标记只对更深的层有意义：取全部输入的并集，只保留与更深层的文件有交集的部分
+    std::vector<RangeTombstone> all, ranges;
+    range_dels->Union(all);
+    size_t d = 0;
+    for (auto &t : all) {
+        while (d < job->deeper.size() && job->deeper[d].second < t.begin)
+            d ++ ;
+        for (size_t k = d; k < job->deeper.size() && job->deeper[k].first <= t.end; ++k)
+            ranges.emplace_back(std::max(t.begin, job->deeper[k].first), std::min(t.end, job->deeper[k].second), 0);
+    }
+    if (range_dels->Empty()) {
+        delete range_dels;
+        range_dels = nullptr;
+    }
 
-        for (int i=0; i<add->num; ++i) {
-            in.read((char*)&(add->key[i]), sizeof(uint64_t));
-            in.read((char*)&(add->offset[i]), sizeof(uint32_t));
+    MergingIterator merger(children, range_dels);
+    SSTableWriter writer(job->time, TableOptions(!ranges.empty()));
+    size_t range = 0; // job->deeper 中第一个右端点不小于当前键的区间
+    size_t next = 0; // ranges 中尚未写出的第一段，写出一部分之后修改其起点
+    bool ok = true;
+
+    auto finish = [&]() {
+        // 注意文件名与时间戳相差 1，新产生的文件具有相同的时间戳，再加全局递增的序号用以区分
+        std::string path = file + "/level" + std::to_string(level) + "/level" + std::to_string(level) + "_" + std::to_string(job->time-1) + "_" + std::to_string(file_seq++) + ".sst";
+        sst_buf *add = writer.Finish(path);
+        if (add == nullptr) {
+            ok = false;
+            return;
         }
-
-        // type 2: 原 list 范围内链表的更新需要与 time_record 时间戳比较
-        if (shadow_type == 2) {
-            for (uint64_t i=0; i<ptr->num; ++i) {
-                uint64_t key = ptr->key[i];
-
-                uint32_t destOffset = add->offset[i];
-                uint32_t destLength;
-                if (i == add->num - 1)
-                    destLength = length - destOffset;
-                else
-                    destLength = add->offset[i + 1] - destOffset;
-
-                char *str_val = new char[destLength + 1];
-                in.read(str_val, destLength);
-                str_val[destLength] = '\0';
-                std::string val = str_val;
-                delete [] str_val;
-
-                uint64_t time_index = key - key_min;
-                if (ptr->time > time_record[time_index]) {
-                    time_record[time_index] = ptr->time;
-                    update_list(key, val, key_min, key_max, list);
-                }
+        job->bytes_written += writer.Written();
+        add->level = level;
+        AttachCaches(add);
+        outputs.push_back(add);
+    };
+
+    while (ok) { // 每一层循环对应着一个键值对的输出，写满 2MB 即生成一个 sst 文件
+        bool done = !merger.Valid();
+
+        if (!done && !writer.Empty() && !writer.Fits(merger.value(), merger.type()))
+            finish();
+
+        // 起点不大于当前键的范围删除标记写入当前文件，越过当前键的部分留给之后的文件，各输出文件的键值区间因此互不重叠
+        uint64_t limit = done ? UINT64_MAX : merger.key();
+        while (next < ranges.size() && ranges[next].begin <= limit) {
+            if (!writer.Empty() && !writer.FitsRange())
+                finish();
+            RangeTombstone &t = ranges[next];
+            if (t.end <= limit) {
+                writer.AddRange(t.begin, t.end);
+                next ++ ;
+            } else {
+                writer.AddRange(t.begin, limit);
+                t.begin = limit + 1;
+                break;
             }
         }
 
-        // type 1: list 扩充范围部分的键值对存储无需与 time_record 比较
-        if (shadow_type == 1) {
-            // 接下来遍历文件所有键值，进行键值对的更新
-            for (uint64_t i=0; i<ptr->num; ++i) {
-                uint64_t key = ptr->key[i];
-
-                uint32_t destOffset = add->offset[i];
-                uint32_t destLength;
-                if (i == add->num - 1)
-                    destLength = length - destOffset;
-                else
-                    destLength = add->offset[i + 1] - destOffset;
-
-                char *str_val = new char[destLength + 1];
-                in.read(str_val, destLength);
-                str_val[destLength] = '\0';
-                std::string val = str_val;
-                delete [] str_val;
-
-                uint64_t time_index = key - key_min;
-                if (time_index < 0) {
-                    update_list(key, val, key_min, key_max, list);
-                    continue;
-                }
-                if (ptr->time > time_record[time_index]) {
-                    time_record[time_index] = ptr->time;
-                    update_list(key, val, key_min, key_max, list);
-                }
-            }
-        }
+        if (done)
+            break;
 
-        // type 3
-        if (shadow_type == 3) {
-            // 接下来遍历文件所有键值，进行键值对的更新
-            for (uint64_t i=0; i<ptr->num; ++i) {
-                uint64_t key = ptr->key[i];
-
-                uint32_t destOffset = add->offset[i];
-                uint32_t destLength;
-                if (i == add->num - 1)
-                    destLength = length - destOffset;
-                else
-                    destLength = add->offset[i + 1] - destOffset;
-
-                char *str_val = new char[destLength + 1];
-                in.read(str_val, destLength);
-                str_val[destLength] = '\0';
-                std::string val = str_val;
-                delete [] str_val;
-
-                if (key > key_max) {
-                    update_list(key, val, key_min, key_max, list);
-                    continue;
-                }
-                uint64_t time_index = key - key_min;
-                if (ptr->time > time_record[time_index]) {
-                    time_record[time_index] = ptr->time;
-                    update_list(key, val, key_min, key_max, list);
-                }
-            }
+        // 被更新的输入文件中的范围删除标记覆盖，该键的全部版本都不再写出
+        if (merger.Covered()) {
+            merger.Next();
+            continue;
         }
 
-        // type 4
-        if (shadow_type == 4) {
-            // 接下来遍历文件所有键值，进行键值对的更新
-            for (uint64_t i=0; i<ptr->num; ++i) {
-                uint64_t key = ptr->key[i];
-
-                uint32_t destOffset = add->offset[i];
-                uint32_t destLength;
-                if (i == add->num - 1)
-                    destLength = length - destOffset;
-                else
-                    destLength = add->offset[i + 1] - destOffset;
-
-                char *str_val = new char[destLength + 1];
-                in.read(str_val, destLength);
-                str_val[destLength] = '\0';
-                std::string val = str_val;
-                delete [] str_val;
-
-                if ((key > key_max) || (key < key_min)) {
-                    update_list(key, val, key_min, key_max, list);
-                    continue;
-                }
-                uint64_t time_index = key - key_min;
-                if (ptr->time > time_record[time_index]) {
-                    time_record[time_index] = ptr->time;
-                    update_list(key, val, key_min, key_max, list);
-                }
+        job->bytes_read += merger.value().length();
+        entries -- ;
+        if (merger.type() == TYPE_DELETION) {
+            uint64_t key = merger.key();
+            while (range < job->deeper.size() && job->deeper[range].second < key)
+                range ++ ;
+            if (range == job->deeper.size() || job->deeper[range].first > key) {
+                job->tombstones_dropped ++ ;
+                merger.Next();
+                continue;
             }
         }
-
-        in.close();
-
-        delete [] add->key;
-        delete [] add->offset;
-        delete add;
-
-        // 如果有交集，该文件以及文件对应的缓存结构体都应该被删除
-        utils::rmfile(ptr->path.c_str());
-        delete [] ptr->key;
-        delete [] ptr->offset;
-        delete ptr;
-
-        Iter++;
+        writer.Add(merger.key(), merger.value(), merger.type());
+        merger.Next();
     }
+    if (ok && !writer.Empty())
+        finish();
+    job->entries_dropped = entries;
+    return ok;
 }
 
-// 函数参数 list: 储存所有的键值对，需要按照 2MB 分解为若干个 sst 文件
-// 函数参数 level: 需要放置新产生文件的层数
-// 函数参数 timeStamp: 新产生的文件具有相同的时间戳，需要再加后缀用以区分
-// 函数功能：产生 sst 文件存储在磁盘上，对应的更新缓存中的链表
-void KVStore::split(std::list<std::pair<uint64_t, std::string>> &list, int level, uint64_t timeStamp) {
-
-    // 首先应该将 list 中所有的空字符串除去
-    std::list<std::pair<uint64_t, std::string>>::iterator del_Iter;
-    del_Iter = list.begin();
-    for ( ; del_Iter != list.end(); ) {
-        if ((*del_Iter).second.empty())
-            del_Iter = list.erase(del_Iter);
-        else
-            del_Iter ++ ;
+// 函数功能：已经完成合并的输入文件移入 retired，由 PurgeRetiredFiles 在旧版本全部释放后删除
+void KVStore::RetireInputs(std::vector<sst_buf *> &inputs) {
+    for (auto ptr : inputs) {
+        ptr->Ref();
+        retired.push_back(ptr);
     }
+    inputs.clear();
+}
 
-    std::vector<std::string> tmp;
-    int all_num = utils::scanDir(file + "/" + "level" + std::to_string(level), tmp);
-    std::vector<std::string>::iterator Iter;
-    Iter = tmp.begin();
-
-    auto * find = new uint64_t [2*all_num];
-    for (int i=0; i<all_num; ++i) { // 提取所有文件的时间戳以及同一时间戳的文件序号
-        std::vector<std::string> res = split('_', *Iter);
-        std::vector<std::string>::iterator Iter2;
-        Iter2 = res.begin();
-        Iter2++;
-        find[2*i] = atoi((*Iter2).c_str());
-        Iter2++;
-        find[2*i+1] = atoi((Iter2)->c_str());
-        Iter++;
-    }
+/**
+ * Insert/Update the key-value pair.
+ * No return values for simplicity.
+ */
+void KVStore::put(uint64_t key, const std::string &s)
+{
+    WriteBatch batch;
+    batch.Put(key, s);
+    write(batch);
+}
 
-    uint64_t file_num = 1; // 记录同一时间戳对应的文件个数
+// 函数功能：put、del 与 delete_range 共用的写入路径，整批只检查一次 MemTable 的大小
+bool KVStore::write(const WriteBatch &batch)
+{
+    if (batch.Empty())
+        return !io_error;
+    Writer w(batch);
+    return Write(w);
+}
 
-    for (int i=0; i<all_num; ++i) {
-        if (find[2*i]==timeStamp-1 && find[2*i+1]+1>file_num) {
-            file_num = find[2*i+1] + 1;
+// 函数功能：经由写队列写入 w 中的全部记录，先写 WAL 再写跳表，公开之后使行缓存中的旧值失效
+// 队首的 leader 在 mutex 之外追加整组的 WAL，期间后来的写者继续排队，下一组由它们中的第一个带领；
+// 序号在 mutex 中按队列顺序分配，与 WAL 中的顺序一致，WAL 回放的结果与并发插入的结果相同
+// 函数返回值 bool: 已经发生写盘错误或者这一组的 WAL 写入失败时整组都不写入，返回 false
+bool KVStore::Write(Writer &w)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    writers.push_back(&w);
+    while (!w.logged && &w != writers.front())
+        w.cv.wait(lock);
+
+    if (!w.logged) {
+        // 合并队列中的写者，第一个写者总是在组内
+        std::vector<Writer *> group;
+        int entries = 0, bytes = 0;
+        for (Writer *x : writers) {
+            if (!group.empty() && bytes + x->batch.Bytes() > WRITE_GROUP_MAX_BYTES)
+                break;
+            group.push_back(x);
+            entries += x->batch.Entries();
+            bytes += x->batch.Bytes();
         }
-    }
 
-    while (true) { // 每一层循环对应着一个 sst 文件的生成
-        uint64_t pair_num = cal_split(list); // 键值对数目立即确定
-        auto *add = new sst_buf;
-        add->time = timeStamp;
-        add->num = pair_num;
-        add->key = new uint64_t [add->num];
-        add->offset = new uint32_t [add->num];
-        int *str_len = new int [add->num];
-
-        std::list<std::pair<uint64_t, std::string>>::iterator Iter;
-        Iter = list.begin();
-        for (uint64_t i=0; i<add->num; ++i) {
-            add->key[i] = (*Iter).first;
-            str_len[i] = (int ) (*Iter).second.length();
-            Iter ++;
+        if (!MakeRoom(lock, entries, bytes)) {
+            for (Writer *x : group) {
+                writers.pop_front();
+                x->logged = true;
+                x->ok = false;
+                if (x != &w)
+                    x->cv.notify_one();
+            }
+            if (!writers.empty())
+                writers.front()->cv.notify_one();
+            return false;
         }
 
-        uint32_t offset = 32 + 10240 + 12 * add->num; // 数据区的起始地址
-        for (uint64_t i=0; i<add->num; ++i) {
-            add->offset[i] = offset;
-            offset += str_len[i];
-        }
-        delete [] str_len;
-
-        for (uint64_t i=0; i<add->num; ++i) {
-            unsigned int hash[4] = {0};
-            MurmurHash3_x64_128(add->key + i, sizeof(uint64_t), 1, hash);
-            add->arr[hash[0] % 81920] = true;
-            add->arr[hash[1] % 81920] = true;
-            add->arr[hash[2] % 81920] = true;
-            add->arr[hash[3] % 81920] = true;
+        std::shared_ptr<SkipList> table = MemTable;
+        std::vector<const LogRecord *> records;
+        for (Writer *x : group) {
+            x->table = table;
+            x->seq = table->BeginWrite(x->batch.Count(), x->batch.Entries(), x->batch.Bytes());
+            for (auto &record : x->batch.Records())
+                records.push_back(&record);
         }
 
-        add->min = add->key[0];
-        add->max = add->key[add->num-1];
-
-        // 注意文件名与时间戳相差 1
-        add->path = file + "/level" + std::to_string(level) + "/level" + std::to_string(level) + "_" + std::to_string(timeStamp-1) + "_" + std::to_string(file_num) + ".sst";
-
-        std::ofstream out(add->path, std::ios::out|std::ios::app|std::ios::binary);
-        out.write((char*)&add->time, sizeof(uint64_t));
-        out.write((char*)&add->num, sizeof(uint64_t));
-        out.write((char*)&add->min, sizeof(uint64_t));
-        out.write((char*)&add->max, sizeof(uint64_t));
-
-        out.write((char*)&add->arr, sizeof(add->arr));
-
-        for (int j=0; j<add->num; ++j) {
-            out.write((char*)&add->key[j], sizeof(uint64_t));
-            out.write((char*)&add->offset[j], sizeof(uint32_t));
+        WriteAheadLog *log = wal;
+        logging = true;
+        lock.unlock();
+        bool ok = log == nullptr || log->AppendBatch(records);
+        lock.lock();
+        logging = false;
+        if (!ok)
+            io_error = true;
+
+        write_stats.writers += group.size();
+        write_stats.groups ++ ;
+        for (Writer *x : group) {
+            writers.pop_front();
+            x->logged = true;
+            x->ok = ok;
+            if (x != &w)
+                x->cv.notify_one();
         }
+        if (!writers.empty())
+            writers.front()->cv.notify_one();
+        cv.notify_all(); // 等待 logging 结束的 Flush 与 reset
+    }
+    lock.unlock();
 
-        for (uint64_t i=0; i< add->num; ++i) { // 将 list 中对应 pair 弹出，将字符串写入文件
-            std::string val = list.front().second;
-            out.write(val.c_str(), (int)val.length());
-            list.pop_front();
+    // 这一组的 WAL 写入失败：不插入任何记录，只公开已经分配的序号，使之后的写者不必等待
+    if (!w.ok) {
+        if (w.table) {
+            w.table->Publish(w.seq);
+            w.table->EndWrite(w.batch.Entries(), w.batch.Bytes());
         }
-
-        out.close();
-
-        add->next = head->next;
-        head->next = add;
-
-        // 处理文件个数增量，循环终止条件判定
-        file_num ++ ;
-
-        if (list.empty())
-            break;
+        return false;
     }
-}
-
-// 函数功能：计算链表从头开始至多多少个键值对可以组成一个 2MB 的 sst 文件
-uint64_t KVStore::cal_split(std::list<std::pair<uint64_t, std::string>> &list) {
-    uint64_t bytes_num = 10240 + 32;
-    uint64_t pair_num = 0;
-
-    std::list<std::pair<uint64_t, std::string>>::iterator Iter;
-    Iter = list.begin();
 
-    while (Iter != list.end()) {
-        uint64_t bytes_add = 12; // 当前迭代器指向的键值对在插入后导致的字节数增量
-        bytes_add += (*Iter).second.length();
-        if (bytes_num + bytes_add <= 2 * 1024 * 1024) {
-            pair_num ++ ;
-            bytes_num += bytes_add;
-            Iter ++ ;
+    // 每个写者在 mutex 之外插入自己的记录，不同的键由多个写者同时插入；范围删除由跳表推迟到公开时应用
+    const std::vector<LogRecord> &records = w.batch.Records();
+    for (size_t i = 0; i < records.size(); ++i) {
+        const LogRecord &record = records[i];
+        if (record.type == TYPE_RANGE_DELETION) {
+            uint64_t end;
+            memcpy(&end, record.val.c_str(), sizeof(uint64_t));
+            w.table->DeleteRange(record.key, end, w.seq + i);
         } else {
-            break;
+            w.table->Insert(record.key, record.val, record.type, w.seq + i);
         }
     }
-
-    return pair_num;
-}
-
-// 传递的参数 level 为触发下溢的层数，希望通过递归调用解决问题
-void KVStore::compaction(int level) {
-
-    // 在当前 level 层计算超额文件个数，并确定参与合并的文件（时间戳小、键值范围小）
-    int merge_num = IsLevelFull("level" + std::to_string(level));
-    std::vector<std::string> tmp;
-    int all_num = utils::scanDir(file + "/" + "level" + std::to_string(level), tmp);
-    std::vector<std::string>::iterator Iter;
-    Iter = tmp.begin();
-
-    // 当前层覆盖范围内所有的键值对链表，作为与下一层的接口
-    std::list<std::pair<uint64_t, std::string>> list;
-    // 将波及的文件以及对应的缓冲区结构体进行删除
-
-    auto * find = new uint64_t [2*all_num];
-    for (int i=0; i<all_num; ++i) { // 提取所有文件的时间戳以及同一时间戳的文件序号
-        std::vector<std::string> res = split('_', *Iter);
-        std::vector<std::string>::iterator Iter2;
-        Iter2 = res.begin();
-        Iter2++;
-        find[2*i] = atoi((*Iter2).c_str());
-        Iter2++;
-        find[2*i+1] = atoi((Iter2)->c_str());
-        Iter++;
-    }
-
-    auto * index = new int [merge_num];
-
-    for (int i=0; i<merge_num; ++i) {
-        int tmp_index = 0;
-        uint64_t tmp_time = find[0];
-        uint64_t tmp_file = find[1];
-        for (int j=1; j<all_num; ++j) {
-            if (find[2*j] < tmp_time) {
-                tmp_index = j;
-                tmp_time = find[2*j];
-                tmp_file = find[2*j+1];
-            }
-            if (find[2*j]==tmp_time && find[2*j+1]<tmp_file) {
-                tmp_index = j;
-                tmp_file = find[2*j+1];
+    w.table->Publish(w.seq);
+
+    // 公开之后才使行缓存失效：此前开始的 get 记下的代数随之过期，不会把 SSTable 中的旧值放回行缓存
+    // 失效之后才 EndWrite，跳表落盘之前行缓存中不会留下被这一批写入覆盖的值
+    if (row_cache) {
+        for (auto &record : records) {
+            if (record.type == TYPE_RANGE_DELETION) {
+                uint64_t end;
+                memcpy(&end, record.val.c_str(), sizeof(uint64_t));
+                row_cache->EraseRange(record.key, end);
+            } else {
+                row_cache->Erase(record.key);
             }
         }
-        index[i] = tmp_index;
-        find[2*tmp_index] = ULONG_LONG_MAX;
-        find[2*tmp_index + 1] = ULONG_LONG_MAX;
     }
+    w.table->EndWrite(w.batch.Entries(), w.batch.Bytes());
+    return true;
+}
 
-    auto * merge_file = new sst_buf* [merge_num]; // 记得回收该指针空间
-
-    for (int i=0; i<merge_num; ++i) {
-        Iter = tmp.begin();
-        for (int j=0; j<index[i]; ++j)
-            Iter++;
-        merge_file[i] = GetBuffer(file + "/level" + std::to_string(level) + "/" + *Iter);
-    }
+// 函数参数 val: 找到时存放 value，为 nullptr 时只确定类型，此时不读取 value，也不放入行缓存
+// 函数返回值 bool: 能否找到 key 的最新记录（包括删除标记），找到时 type 为其类型
+// 函数功能：依次查找 MemTable、ImmTable、行缓存，再逐层检查 Bloom Filter 并在可能包含 key 的 SSTable 中查找
+// mutex 只用于取得两个跳表的引用，查找跳表不加锁
+bool KVStore::Find(uint64_t key, std::string *val, ValueType &type)
+{
+    bool flag; // 在跳表中能否找到目标值
+    std::string scratch;
+    std::string &dest = val != nullptr ? *val : scratch;
+    uint64_t generation = 0; // 行缓存中 key 所在分片的代数，此后有写入时不将 SSTable 中找到的值放入行缓存
+    std::shared_ptr<SkipList> mem, imm;
 
-    uint64_t key_min = merge_file[0]->min;
-    uint64_t key_max = merge_file[0]->max;
-    // 当前层溢出文件的最大时间戳
-    uint64_t new_time = merge_file[0]->time;
+    if (row_cache)
+        generation = row_cache->Generation(key); // 先于查找跳表，此后公开的写入都会使它过期
 
-    for (int i=1; i<merge_num; ++i) {
-        if (merge_file[i]->min < key_min) key_min = merge_file[i]->min;
-        if (merge_file[i]->max > key_max) key_max = merge_file[i]->max;
-        if (merge_file[i]->time > new_time) new_time = merge_file[i]->time;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        mem = MemTable;
+        imm = ImmTable;
     }
 
-    for (uint64_t i=0; i<(key_max - key_min + 1); ++i) {
-        std::pair<uint64_t, std::string> insert (key_min + i, "");
-        list.push_back(insert);
-    } // 初始化，将所有键的值设为空的 ""
-
-    // 与链表 list 相对应的时间戳数组，为与下一层合并做准备
-    auto *time_record = new uint64_t [key_max - key_min + 1];
-    for (uint64_t i=0; i<key_max - key_min + 1; ++i)
-        time_record[i] = 0; //记录当前时间戳的数组，并且全部初始化为 0
-
-    for (int i=0; i<merge_num; ++i) {
-
-        std::ifstream in;
-        in.open(merge_file[i]->path, std::ios::binary|std::ios::in);
+    flag = mem->Search(key, dest, type);
+    if (!flag && imm)
+        flag = imm->Search(key, dest, type);
 
-        in.seekg(0, std::ifstream::end); // 将文件指针指向输入流的末尾
-        long long length = in.tellg(); // 获得文件总的字节数
-        in.seekg(0, std::ifstream::beg); // 回到输入流的头部
-
-        auto *add = new sst_buf;
-
-        in.read((char*)&(add->time), sizeof(uint64_t));
-        in.read((char*)&(add->num), sizeof(uint64_t));
-        in.read((char*)&(add->min), sizeof(uint64_t));
-        in.read((char*)&(add->max), sizeof(uint64_t));
-
-        in.read((char*)&(add->arr), sizeof(add->arr));
+    if (flag)
+        return true;
 
-        add->key = new uint64_t [add->num];
-        add->offset = new uint32_t [add->num]; // 动态分配内存后记得释放堆空间
+    // 跳表中没有的键才查找行缓存：写者公开之后、使行缓存失效之前，缓存中的旧值已经被跳表中的新值遮盖，
+    // 读者不会看到一批写入中的一部分键是新值而另一部分键还是缓存中的旧值
+    if (row_cache && row_cache->Lookup(key, dest, type))
+        return true;
 
-        for (int j=0; j < add->num; ++j) {
-            in.read((char*)&(add->key[j]), sizeof(uint64_t));
-            in.read((char*)&(add->offset[j]), sizeof(uint32_t));
+    // 固定当前版本后不再加锁，与落盘、compaction 以及其他读者并行
+    std::shared_ptr<const Version> current = CurrentVersion();
+    uint64_t bloom_probes = 0, index_searches = 0;
+
+    // 每次查找只计算一次哈希
+    uint64_t hash[2];
+    BloomFilter::Hash(key, hash);
+
+    bool found = false;
+
+    // 检查 Bloom Filter 后在 find 中查找目标键值，找到时 val 与 type 即为对应的 value 与类型
+    // 文件中的键值对都比它自己的范围删除标记新，没有找到该键时才检查范围删除标记
+    auto probe = [&](sst_buf *find) {
+        find->Load();
+        if (find->num > 0) {
+            bloom_probes ++ ;
+            if (find->MayContain(hash)) {
+                index_searches ++ ;
+                found = find->Get(key, val, type);
+                if (found)
+                    return true;
+            }
         }
 
-        for (uint64_t j=0; j<merge_file[i]->num; ++j) {
-            uint64_t key = merge_file[i]->key[j];
-            uint64_t dest_index = j;
-            uint32_t destOffset = add->offset[dest_index];
-            uint32_t destLength;
-            if (dest_index == add->num - 1)
-                destLength = length - destOffset;
-            else
-                destLength = add->offset[dest_index + 1] - destOffset;
-
-            char *str_val = new char[destLength + 1];
-            in.read(str_val, destLength);
-            str_val[destLength] = '\0';
-            std::string val = str_val;
-            delete [] str_val;
-
-            uint64_t time_index = key - key_min;
-            update_list(key, val, key_min, key_max, list);
-            time_record[time_index] = merge_file[i]->time;
+        if (find->RangeDeleted(key)) {
+            if (val != nullptr)
+                val->clear();
+            type = TYPE_DELETION;
+            found = true;
         }
+        return found;
+    };
 
-        delete [] add->key;
-        delete [] add->offset;
-        delete add;
-
-        in.close();
-    }
-
-    for (int i = 0; i < merge_num; ++i) {
-        utils::rmfile((merge_file[i]->path).c_str());
+    // level0 从新到旧，再逐层向下，每层至多访问一个文件，第一个找到的记录（包括删除标记）就是最新的
+    for (auto find : current->Files(0)) {
+        if (find->min <= key && key <= find->max && probe(find))
+            break;
     }
-
-    for (int i=0; i<merge_num; ++i) {
-        delete [] merge_file[i]->key;
-        delete [] merge_file[i]->offset;
-        delete merge_file[i];
+    for (int level = 1; !found && level <= current->MaxLevel(); ++level) {
+        sst_buf *find = current->FindFile(level, key);
+        if (find != nullptr)
+            probe(find);
     }
 
-    delete [] merge_file;
-
-    delete [] find;
-    delete [] index;
+    stat_gets ++ ;
+    stat_tables += current->NumFiles();
+    stat_bloom_probes += bloom_probes;
+    stat_index_searches += index_searches;
 
-    // 其次判断 level + 1 是否存在（若存在一定可以说明该层有若干文件）
-    bool level_exist = utils::dirExists(file + "/level" + std::to_string(level+1));
-
-    // case 1: 如果不存在 -> 获取 level 的键值覆盖区间
-    if (!level_exist) {
-        delete [] time_record;
-
-        // 按 2MB 划分为新的 level1 文件（不可能继续下溢）, 更新缓存中的链表（新时间戳取 max -> 注意对于文件的重命名）
-        utils::mkdir((file + "/level" + std::to_string(level+1)).c_str());
-        split(list, level+1, new_time);
-        return;
-    }
-
-    // case 2: 如果存在 -> 获取 level 的键值覆盖区间
-    if (level_exist) {
-        // 在 level+1 中寻找与该区间有交集的所有 sst 文件，合在一起进行归并排序
-        expansion(list, new_time, level+1, time_record);
-        delete [] time_record;
-        split(list, level+1, new_time);
-
-        // 判断 level+1 是否会触发新的下溢
-        bool flag = IsLevelFull("level" + std::to_string(level+1));
-
-        if (!flag)
-            return;
-        else // 如果继续下溢，那么递归地调用 compaction 携参函数
-            compaction(level+1);
-    }
+    if (found && row_cache && val != nullptr)
+        row_cache->Insert(key, *val, type, generation);
+    return found;
 }
 
-/**
- * Insert/Update the key-value pair.
- * No return values for simplicity.
- */
-void KVStore::put(uint64_t key, const std::string &s)
+// 调用者为写队列的 leader：MemTable 再写入 entries 个键值对共 bytes 字节（以及它们的 Bloom Filter）之后会超过单个 sst 文件的大小时，
+// 将其切换为 ImmTable；反复用更长的 value 更新同一批键时文件大小不增长，内存池中废弃的字节超过单个 sst 文件的大小时同样切换
+// 函数返回值 bool: 已经发生写盘错误时返回 false，这一组不能写入
+bool KVStore::MakeRoom(std::unique_lock<std::mutex> &lock, int entries, int bytes)
 {
-    bool flag = false; // 插入后是否会超过限制
-    int cur_bytes = MemTable.GetCurrentDataLength();
-    cur_bytes = cur_bytes + 12 + (int) s.length();
-    if (cur_bytes > 2 * 1024 * 1024) flag = true;
-
-    if (!flag) {
-        MemTable.Insert(key, s);
-    } // 直接在跳表中插入
-    else {
-        WriteToDisk();
-        MemTable.Insert(key, s);
-    }
-}
+    if (io_error)
+        return false;
 
-uint64_t KVStore::binarySearch(const uint64_t *a, uint64_t n, uint64_t target)
-{
-    uint64_t low = 0, high = n-1, middle;
-    while(low <= high)
-    {
-        middle = low + (high - low) / 2;
-        if(target == a[middle])
-            return middle;
-        else if(target > a[middle])
-            low = middle + 1;
-        else if(target < a[middle]) {
-            if (middle == 0)
-                return -1;
-            else
-                high = middle - 1;
-        }
-    }
-    return -1;
-} // 返回值为数组下标，-1表示没有找到
+    int cur_bytes = MemTable->GetCurrentDataLength();
+    cur_bytes = cur_bytes + bytes + (int) BloomFilter::BlockedBytes(MemTable->GetCount() + entries, options.bloom_bits_per_key);
+    if (cur_bytes <= SST_MAX_SIZE && MemTable->GetWastedBytes() <= SST_MAX_SIZE)
+        return true;
+
+    // 只有两个缓冲区都已写满时才需要等待后台线程落盘，落盘失败时 ImmTable 不再清空
+    while (ImmTable && !io_error)
+        cv.wait(lock);
+    if (io_error)
+        return false;
+    SwitchMemTable();
+    return true;
+}
 
 /**
  * Returns the (string) value of the given key.
@@ -1129,99 +995,43 @@ uint64_t KVStore::binarySearch(const uint64_t *a, uint64_t n, uint64_t target)
  */
 std::string KVStore::get(uint64_t key)
 {
-    bool flag; // 在跳表中能否找到目标值
     std::string val;
-
-    flag = MemTable.Search(key, val);
-    if (flag) {
-        if (val == "~DELETED~")
-            return "";
-        else return val;
-    }
-    else {
-        // 遍历缓冲区的 sst_buf 查找
-        sst_buf *find = head->next;
-        sst_buf *dest = nullptr;
-        uint64_t dest_index; // dest 为最后确定的 SSTable
-
-        while (find != nullptr) {
-
-            unsigned int hash[4] = {0};
-            MurmurHash3_x64_128(&key, sizeof(uint64_t), 1, hash);
-
-            bool exist = false; // 是否可能存在于当前 SSTable 中
-            if (find->arr[hash[0] % 81920] && find->arr[hash[1] % 81920] && find->arr[hash[2] % 81920] && find->arr[hash[3] % 81920])
-                exist = true;
-
-            if (exist) {
-                // 用二分查找法读取 offset 指向的内容
-                uint64_t index = binarySearch(find->key, find->num, key);
-                if (index == -1) {
-                    find = find->next;
-                    continue;
-                }
-
-                if (dest == nullptr) {
-                    dest = find;
-                    dest_index = index;
-                }
-                else { // 与最大时间戳进行比较并决定取舍
-                    if (find->time > dest->time) {
-                        dest = find;
-                        dest_index = index;
-                    }
-                }
-            }
-
-            find = find->next;
-        }
-
-        if (dest == nullptr)
-            return "";
-
-        std::ifstream in;
-        in.open(dest->path, std::ios::binary|std::ios::in);
-
-        in.seekg(0, std::ifstream::end); // 将文件指针指向输入流的末尾
-        long long length = in.tellg(); // 获得文件总的字节数
-        in.seekg(0, std::ifstream::beg); // 回到输入流的头部
-
-        uint32_t destOffset = dest->offset[dest_index];
-        uint32_t destLength;
-        if (dest_index == dest->num - 1)
-            destLength = length - destOffset;
-        else
-            destLength = dest->offset[dest_index + 1] - destOffset;
-
-        in.seekg(destOffset); // 对文件指针进行目标量的偏移
-        char *str_val = new char[destLength + 1];
-        in.read(str_val, destLength);
-        str_val[destLength] = '\0';
-        val = str_val;
-        delete [] str_val;
-
-        in.close();
-
-        // 找到最大时间戳对应的 value 值并返回
-        if (val == "~DELETED~")
-            return "";
-        else return val;
-    }
+    ValueType type;
+    if (!Find(key, &val, type) || type == TYPE_DELETION)
+        return "";
+    return val;
 }
 
 /**
  * Delete the given key-value pair if it exists.
  * Returns false iff the key is not found.
  */
+// 只需要知道 key 是否存在：跳表或行缓存中有记录、各层 Bloom Filter 都排除时不访问任何文件，
+// 逐键索引的格式由 value 的长度就能排除删除标记，不存在时不写入删除标记
 bool KVStore::del(uint64_t key)
 {
-    std::string target = get(key);
-    if (target.empty())
+    ValueType type;
+    if (!Find(key, nullptr, type) || type == TYPE_DELETION)
         return false;
-    else {
-        put(key, "~DELETED~");
-        return true;
-    }
+    delete_blind(key);
+    return true;
+}
+
+// 函数功能：不查找 key 是否存在，直接写入删除标记，代价与一次 put 相同
+void KVStore::delete_blind(uint64_t key)
+{
+    WriteBatch batch;
+    batch.Delete(key);
+    write(batch);
+}
+
+// 函数功能：删除 [begin, end] 中的全部键值对，只写入一条 WAL 记录与一段范围删除标记，代价与区间宽度无关
+// 区间内的数据在 compaction 时与范围删除标记相遇后丢弃，标记到达最深的覆盖层后也被丢弃
+void KVStore::delete_range(uint64_t begin, uint64_t end)
+{
+    WriteBatch batch;
+    batch.DeleteRange(begin, end);
+    write(batch);
 }
 
 /**
@@ -1230,30 +1040,35 @@ bool KVStore::del(uint64_t key)
  */
 void KVStore::reset()
 {
-    // 清除跳表
-    SKNode *n1 = MemTable.head->forwards[0];
-    SKNode *n2;
-    while (n1->type != SKNodeType::NIL) {
-        n2 = n1->forwards[0];
-        delete n1;
-        n1 = n2;
-    }
-    for (int i = 0; i < MAX_LEVEL; ++i)
+    // 等待后台线程完成正在进行的落盘，然后清除跳表
     {
-        MemTable.head->forwards[i]->type = NIL;
-    } // 重新将 head NIL 进行连接
-
-    // 清除 SSTable 的缓存部分
-    sst_buf *del = head;
-    while (head != nullptr) {
-        head = head->next;
-        delete [] del->key;
-        delete [] del->offset;
-        delete del;
-        del = head;
+        std::unique_lock<std::mutex> lock(mutex);
+        while ((ImmTable && !io_error) || logging)
+            cv.wait(lock);
+        MemTable = std::make_shared<SkipList>();
+        if (ImmTable) {
+            ImmTable.reset(); // 落盘失败而保留的 ImmTable 与它的 WAL 一并清除
+            utils::rmfile((file + "/wal.imm.log").c_str());
+        }
+        if (wal)
+            wal->Truncate();
     }
-    head = new sst_buf;
-    head->next = nullptr; // 析构后需要配置头结点
+
+    // 正在进行的 compaction 完成之后才能删除文件
+    scheduler->WaitIdle();
+    std::lock_guard<std::mutex> lock(sst_mutex);
+
+    // 清除 SSTable 的缓存部分，先清空 MANIFEST 再删除文件；下面逐个删除目录中的全部文件，等待删除的输入文件不再单独删除
+    InstallVersion(std::make_shared<Version>());
+    for (auto ptr : retired)
+        ptr->Unref();
+    retired.clear();
+    table_cache->Clear();
+    if (block_cache)
+        block_cache->Clear();
+    if (row_cache)
+        row_cache->Clear(); // 代数随之增加，此前开始的 get 在旧版本中找到的值都不会再放入
+    manifest->WriteSnapshot(*version, 0, file_seq);
 
     bool isEmpty;
     isEmpty = utils::dirExists(file + "/level0");
@@ -1298,132 +1113,51 @@ void KVStore::reset()
  */
 void KVStore::scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list)
 {
-    for (uint64_t i=0; i<(key2-key1+1); ++i) {
-        std::pair<uint64_t, std::string> insert (key1+i, "");
-        list.push_back(insert);
-    } // 初始化，将所有键的值设为空的 ""
-
-    auto *time_record = new uint64_t [key2-key1+1];
-    for (uint64_t i=0; i<key2-key1+1; ++i)
-        time_record[i] = 0; //记录当前时间戳的数组，并且全部初始化为 0
-
-    // 扫描 MemTable 将列表中的字符串更新
-    SKNode *travel = MemTable.head->forwards[0];
-    while (travel->type != SKNodeType::NIL) {
-        if (travel->key>=key1 && travel->key<=key2) {
-            update_list(travel->key, travel->val, key1, key2, list);
-            time_record[travel->key - key1] = time_max + 1;
-        }
-        travel = travel->forwards[0];
-    }
-
-    sst_buf *ptr = head->next;
-    while (ptr != nullptr) {
-        std::ifstream in;
-        in.open(ptr->path, std::ios::binary|std::ios::in);
-
-        // 首先从文件数据区读到所有的字符串
-        in.seekg(0, std::ifstream::end); // 将文件指针指向输入流的末尾
-        long long length = in.tellg(); // 获得文件总的字节数
-        in.seekg(0, std::ifstream::beg); // 回到输入流的头部
-
-        auto *add = new sst_buf;
-
-        in.read((char*)&(add->time), sizeof(uint64_t));
-        in.read((char*)&(add->num), sizeof(uint64_t));
-        in.read((char*)&(add->min), sizeof(uint64_t));
-        in.read((char*)&(add->max), sizeof(uint64_t));
-
-        in.read((char*)&(add->arr), sizeof(add->arr)); // 载入 Bloom Filter
-
-        long long data_len = length - 10272 - 12 * (long long)add->num; // 此为数据区的总的字节个数
-
-        add->key = new uint64_t [add->num];
-        add->offset = new uint32_t [add->num];
-
-        for (int i=0; i<add->num; ++i) {
-            in.read((char*)&(add->key[i]), sizeof(uint64_t));
-            in.read((char*)&(add->offset[i]), sizeof(uint32_t));
-        }
+    Iterator *iter = NewIterator(key1, key2);
+    for ( ; iter->Valid(); iter->Next())
+        list.emplace_back(iter->key(), iter->value());
+    delete iter;
+}
 
-        // 开始读入数据区字符串
-        auto **str_ptr = new char* [add->num];
-        for (int i = 0; i < add->num; ++i) {
-            if (i != add->num-1) {
-                char *str_val = new char[add->offset[i + 1] - add->offset[i] + 1];
-                in.read(str_val, add->offset[i + 1] - add->offset[i]);
-                str_val[add->offset[i + 1] - add->offset[i]] = '\0';
-                data_len -= (add->offset[i + 1] - add->offset[i]);
-                str_ptr[i] = str_val;
-            } else {
-                char *str_val = new char[data_len + 1];
-                in.read(str_val, data_len);
-                str_val[data_len] = '\0';
-                str_ptr[i] = str_val;
-            }
+// 函数参数 lower/upper: 迭代器覆盖的键值区间
+// 函数返回值 Iterator* : 已经定位到 lower 的迭代器，调用者负责 delete
+// 函数功能：将跳表与键值区间有交集的 SSTable 按新旧程度归并，只在读取 value 时访问对应文件的数据区
+Iterator *KVStore::NewIterator(uint64_t lower, uint64_t upper)
+{
+    std::vector<InternalIterator *> children;
+    auto *range_dels = new RangeDeletions; // 跳表中的范围删除标记在此时复制，之后的写入不影响迭代器
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<RangeTombstone> fragments;
+        uint64_t snapshot = MemTable->RangeFragments(fragments);
+        children.push_back(new SkipListIterator(MemTable, UINT64_MAX, snapshot));
+        range_dels->Add(-1, UINT64_MAX, fragments);
+        if (ImmTable) {
+            fragments.clear();
+            snapshot = ImmTable->RangeFragments(fragments);
+            children.push_back(new SkipListIterator(ImmTable, UINT64_MAX - 1, snapshot));
+            range_dels->Add(-1, UINT64_MAX - 1, fragments);
         }
+    }
 
-        delete [] add->key;
-        delete [] add->offset;
-        delete add;
+    std::shared_ptr<const Version> current = CurrentVersion();
 
-        // 需要遍历每个文件里的所有键，如果符合条件则会对于链表进行 update
-        for (int i=0; i<ptr->num; ++i) {
-            uint64_t target = ptr->key[i];
-            if (target>=key1 && target<=key2 && ptr->time>time_record[target-key1]) {
-                update_list(target, str_ptr[i], key1, key2, list);
-                time_record[target-key1] = ptr->time;
+    for (int level = 0; level <= current->MaxLevel(); ++level) {
+        for (auto ptr : current->Files(level)) {
+            if (ptr->max >= lower && ptr->min <= upper) { // 跳过键值区间与目标范围不相交的文件
+                children.push_back(new SSTableIterator(ptr));
+                range_dels->Add(ptr->level, ptr->time, ptr->range_tombstones);
             }
         }
-
-        for (int i=0; i<ptr->num; ++i)
-            delete [] str_ptr[i];
-        delete [] str_ptr;
-
-        in.close();
-
-        ptr = ptr->next;
     }
-
-    std::list<std::pair<uint64_t, std::string>>::iterator del_Iter;
-    del_Iter = list.begin();
-    for ( ; del_Iter != list.end(); ) {
-        if ((*del_Iter).second.empty() || !std::strcmp((*del_Iter).second.c_str(), "~DELETED~"))
-            del_Iter = list.erase(del_Iter);
-        else
-            del_Iter ++ ;
+    if (range_dels->Empty()) {
+        delete range_dels;
+        range_dels = nullptr;
     }
 
-    delete [] time_record;
-}
-
-void KVStore::update_list(uint64_t key, const std::string val, uint64_t key1, uint64_t key2,
-                          std::list<std::pair<uint64_t, std::string>> &list) {
-    key1 = list.front().first;
-    // 在 list 中找到键值 key
-    uint64_t count = key - key1; // 需要移动迭代器的次数
-    std::list<std::pair<uint64_t, std::string>>::iterator Iter;
-    Iter = list.begin();
-    for (uint64_t i=0; i<count; ++i)
-        Iter++;
-    std::pair<uint64_t, std::string> insert (key, val);
-    *Iter = insert;
-}
-
-// 判断当前目录是否已经装满 sst 文件，也就是会不会触发下溢
-int KVStore::IsLevelFull(const std::string &dir) {
-
-    std::vector<std::string> tmp;
-    int cur_sst_num = utils::scanDir(file + "/" + dir, tmp); // 当前文件数目
-
-    std::string cut = dir.substr(5);
-    int cur_level_num = atoi(cut.c_str());
-    int max_sst_num = 1 << (cur_level_num + 1); // 最大文件数目为 2 的幂次方
-
-    if (cur_sst_num <= max_sst_num)
-        return 0;
-    else
-        return (cur_sst_num - max_sst_num);
+    auto *iter = new Iterator(new MergingIterator(children, range_dels), upper, std::move(current));
+    iter->Seek(lower);
+    return iter;
 }
 
 std::vector<std::string> KVStore::split(char c, std::string src) {
@@ -1,68 +1,198 @@
 #pragma once
 
 #include "kvstore_api.h"
-#include <bitset>
 #include "skiplist.h"
+#include "sstable.h"
+#include "wal.h"
+#include "options.h"
+#include "scheduler.h"
+#include "version.h"
+#include "manifest.h"
+#include "row_cache.h"
+#include "write_batch.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #include "utils.h"
 
-struct sst_buf {
-    uint64_t time; // SSTable的时间戳
-    uint64_t num; // SSTable键值对的数量
-    uint64_t min; // 键的最小值
-    uint64_t max; // 键的最大值
+#define WRITE_GROUP_MAX_BYTES (1024 * 1024) // leader 合并的一组写入的总长度上限，限制组内第一个写者的等待时间
+
+// compaction 的累计统计信息，用于衡量归并吞吐量
+struct CompactionStats {
+    uint64_t count; // compaction 的次数
+    uint64_t bytes_read; // 读入的 sst 文件总字节数
+    uint64_t bytes_written; // 写出的 sst 文件总字节数
+    uint64_t micros; // 耗费的总时间（微秒）
+    uint64_t entries_dropped; // 被同一键更新的版本遮盖而丢弃的键值对个数
+    uint64_t tombstones_dropped; // 输出层已是最深的覆盖层而丢弃的删除标记个数
+
+    CompactionStats() {
+        count = 0;
+        bytes_read = 0;
+        bytes_written = 0;
+        micros = 0;
+        entries_dropped = 0;
+        tombstones_dropped = 0;
+    }
+};
 
-    // Bloom Filter
-    std::bitset<10240 * 8> arr;
+// get 的累计统计信息，用于衡量每次查找访问了多少个 SSTable
+struct ReadStats {
+    uint64_t gets; // 需要在 SSTable 中查找的 get 次数
+    uint64_t bloom_probes; // 检查 Bloom Filter 的次数
+    uint64_t index_searches; // 在索引区中二分查找的次数
+    uint64_t tables; // 查找时 SSTable 的总数，即逐个遍历全部文件需要检查 Bloom Filter 的次数
+    uint64_t table_cache_hits; // 读取 sst 文件时已经打开的次数（包括迭代器与 compaction）
+    uint64_t table_cache_misses; // 需要重新打开文件的次数
+    uint64_t block_cache_hits; // 数据块在块缓存中的次数（包括迭代器与 compaction）
+    uint64_t block_cache_misses; // 需要从文件中读入数据块的次数
+    uint64_t block_cache_bytes; // 块缓存目前占用的字节数
+    uint64_t row_cache_hits; // get 直接由行缓存返回的次数
+    uint64_t row_cache_misses;
+
+    ReadStats() {
+        gets = 0;
+        bloom_probes = 0;
+        index_searches = 0;
+        tables = 0;
+        table_cache_hits = 0;
+        table_cache_misses = 0;
+        block_cache_hits = 0;
+        block_cache_misses = 0;
+        block_cache_bytes = 0;
+        row_cache_hits = 0;
+        row_cache_misses = 0;
+    }
+};
 
-    // 索引区，动态数组大小为键值对数量 num 的两倍
-    uint64_t *key;
-    uint32_t *offset;
+// 写入的累计统计信息，用于衡量写队列的合并效果
+struct WriteStats {
+    uint64_t writers; // 经过写队列的写入次数（put、del、delete_range 与 write 各计一次）
+    uint64_t groups; // leader 合并出的组数，即追加 WAL 的次数
 
-    // 读入内存的SSTable形成单链表
-    sst_buf *next;
+    WriteStats() {
+        writers = 0;
+        groups = 0;
+    }
+};
 
-    // 在缓冲区的每个结构体中加入磁盘对应文件的路径 (COMPACTION)
-    std::string path;
+// 写队列中的一次写入：排在队首的写者成为 leader，将其后等待的写者合为一组，一次追加 WAL 并按策略刷盘，
+// 按组内顺序连续分配序号后唤醒它们；每个写者各自插入跳表，同一组的写者并行插入，插入完成后整批公开
+struct Writer {
+    const WriteBatch &batch;
+    std::shared_ptr<SkipList> table; // leader 写入 WAL 之后设置
+    uint64_t seq; // 第一条记录的写入序号，其余依次加一
+    bool logged; // 是否已经由 leader 写入 WAL
+    bool ok; // 为 false 时整批都没有写入（已经发生写盘错误，或者这一组的 WAL 写入失败）
+    std::condition_variable cv;
+
+    explicit Writer(const WriteBatch &batch): batch(batch) {
+        seq = 0;
+        logged = false;
+        ok = true;
+    }
+};
 
-    sst_buf() {
+// 一次 compaction：将 level 层的 upper 与 level + 1 层中与之有交集的 lower 归并，输出到 level + 1 层
+struct CompactionJob {
+    int level;
+    std::vector<sst_buf *> upper;
+    std::vector<sst_buf *> lower;
+    uint64_t key_min; // 输出的键值覆盖区间，并发的 compaction 之间不能重叠
+    uint64_t key_max;
+    uint64_t time; // 输出文件的时间戳
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t entries_dropped;
+    uint64_t tombstones_dropped;
+    // level + 2 及以下各层中与 [key_min, key_max] 有交集的文件所覆盖的区间，合并为互不重叠的升序区间
+    // 不落在其中的键在输出层之下没有更旧的版本，它的删除标记可以丢弃
+    std::vector<std::pair<uint64_t, uint64_t> > deeper;
+
+    CompactionJob() {
+        level = 0;
+        key_min = 0;
+        key_max = 0;
         time = 0;
-        num = 0;
-        min = 0;
-        max = 0;
-        key = nullptr;
-        offset = nullptr;
-        next = nullptr;
-    };
+        bytes_read = 0;
+        bytes_written = 0;
+        entries_dropped = 0;
+        tombstones_dropped = 0;
+    }
 };
 
 class KVStore : public KVStoreAPI {
 private:
 
-    sst_buf *head;
+    // 磁盘上全部 SSTable 的当前版本：只在持有 sst_mutex 时替换，读者经由 CurrentVersion 取得引用后不加锁
+    std::shared_ptr<const Version> version;
+    std::vector<sst_buf *> retired; // 已经被 compaction 取代、可能仍在旧版本中的输入文件，各持有一个引用
+    Manifest *manifest; // version 的每次修改都先记入 MANIFEST
+    TableCache *table_cache; // version 中的文件都经由它打开，删除文件之前先从中移除
+    BlockCache *block_cache; // 各文件解压后的数据块，未开启时为 nullptr
+    RowCache *row_cache; // 在 SSTable 中找到的热点键，写入时失效，未开启时为 nullptr
     uint64_t time_max;
     std::string file;
-
-    void WriteToDisk();
-    static uint64_t binarySearch(const uint64_t a[], uint64_t n, uint64_t target);
-    static void update_list(uint64_t key, const std::string val, uint64_t key1, uint64_t key2, std::list< std::pair<uint64_t, std::string> > &list);
-
-    // COMPACTION
-    int level_max;
-    int IsLevelFull(const std::string &dir);
-    void compaction(); // 默认是从 level0 到 level1 的 compaction
-    void compaction(int level); // 默认是从 level 到 level + 1 的 compaction
-    sst_buf* GetBuffer(const std::string &path);
-    void split(std::list<std::pair<uint64_t, std::string> > &list, int level, uint64_t timeStamp);
-    static uint64_t cal_split(std::list<std::pair<uint64_t, std::string> > &list);
-    void expansion(std::list<std::pair<uint64_t, std::string> > &list, uint64_t &timeStamp, int cur_level, uint64_t time_record[]);
+    Options options;
+    WriteAheadLog *wal; // 未开启 WAL 时为 nullptr
+
+    // 双缓冲：MemTable 写满后整体移入 ImmTable，由后台线程落盘，前台继续写入新的 MemTable
+    std::shared_ptr<SkipList> MemTable;
+    std::shared_ptr<SkipList> ImmTable; // 为空说明没有等待落盘的跳表
+    uint64_t imm_time; // ImmTable 落盘后 SSTable 的时间戳
+
+    std::mutex mutex; // 保护 MemTable、ImmTable 的切换、写队列以及写入序号的分配，插入与查找跳表不需要它
+    std::mutex sst_mutex; // 保护 version 的替换、running、retired 以及磁盘上的 sst 文件
+    std::condition_variable cv;
+    std::deque<Writer *> writers; // 等待写入 WAL 的写者，队首为 leader
+    bool logging; // leader 正在 mutex 之外追加 WAL，此时不能切换 MemTable 与 WAL
+    WriteStats write_stats;
+    Scheduler *scheduler; // 落盘与 compaction 都在后台线程池中执行，前台不做任何 compaction
+
+    // 写 WAL、sst 文件或 MANIFEST 出错（如磁盘已满）之后为 true：出错的落盘与 compaction 不删除任何文件，ImmTable 与 WAL 保留到下次打开时恢复，
+    // 此后不再落盘与 compaction，新的写入全部失败
+    std::atomic<bool> io_error;
+
+    void LoadLegacy(Version &initial);
+    void AttachCaches(sst_buf *add);
+    bool Write(Writer &w);
+    bool MakeRoom(std::unique_lock<std::mutex> &lock, int entries, int bytes);
+    bool Find(uint64_t key, std::string *val, ValueType &type);
+    void RemoveObsoleteFiles();
+    bool WriteToDisk(const SkipList &table, uint64_t timeStamp);
+    Options TableOptions(bool range_deletions) const;
+    void SwitchMemTable();
+    void BackgroundFlush();
+
+    // COMPACTION（以下函数中不带 Run 的均要求调用者持有 sst_mutex）
+    std::atomic<uint64_t> file_seq; // 新文件名的序号，保证并发的 compaction 不会产生同名文件
+    std::vector<CompactionJob *> running; // 已选定输入、尚未完成的 compaction
+    double LevelScore(int level);
+    CompactionJob *PickCompaction(int level);
+    void MaybeScheduleCompaction();
+    void RunCompaction(CompactionJob *job);
+    bool split(CompactionJob *job, std::vector<sst_buf *> &outputs);
+    void RetireInputs(std::vector<sst_buf *> &inputs);
+    void PurgeRetiredFiles();
+    void InstallVersion(std::shared_ptr<Version> next);
+    std::shared_ptr<const Version> CurrentVersion() const;
+    CompactionStats stats;
+
+    // get 在不加锁的查找中累加的计数，GetReadStats 时汇总
+    std::atomic<uint64_t> stat_gets;
+    std::atomic<uint64_t> stat_bloom_probes;
+    std::atomic<uint64_t> stat_index_searches;
+    std::atomic<uint64_t> stat_tables;
     std::vector<std::string> split(char c, std::string src);
 
 public:
 
-    SkipList MemTable;
-
 	KVStore(const std::string &dir);
 
+	KVStore(const std::string &dir, const Options &options);
+
 	~KVStore();
 
 	void put(uint64_t key, const std::string &s) override;
@@ -71,9 +201,35 @@ public:
 
 	bool del(uint64_t key) override;
 
+    // 删除 key 而不读取其旧值，不关心返回值的批量删除应当使用它
+    void delete_blind(uint64_t key);
+
+    // 删除 [begin, end]（包含两端）中的全部键值对
+    void delete_range(uint64_t begin, uint64_t end);
+
+    // 原子地写入 batch 中的全部记录：WAL 中只有一条记录，读者要么看到整批的结果，要么一条也看不到
+    // 发生写盘错误之后返回 false，整批都没有写入
+    bool write(const WriteBatch &batch);
+
 	void reset() override;
 
 	void scan(uint64_t key1, uint64_t key2, std::list<std::pair<uint64_t, std::string> > &list) override;
 
+    Iterator *NewIterator(uint64_t lower = 0, uint64_t upper = UINT64_MAX);
+
     static std::string GetString(const std::string &path, uint64_t key);
+
+    // 将跳表中的全部内容写入 SSTable，并等待后台的落盘与 compaction 完成
+    void Flush();
+
+    // 是否发生过写盘错误，此后 put 等没有返回值的写入都被丢弃
+    bool HasError() const {return io_error;}
+
+    CompactionStats GetCompactionStats();
+
+    ReadStats GetReadStats();
+
+    WriteStats GetWriteStats();
+
+    uint64_t GetIndexMemory();
 };
@@ -0,0 +1,199 @@
+#include "manifest.h"
+#include "utils.h"
+#include <fstream>
+#include <map>
+#include <cstdio>
+#include <cerrno>
+
+template<typename T>
+static void PutValue(std::string &dst, T value)
+{
+    dst.append((const char*)&value, sizeof(T));
+}
+
+// 从 src 的 pos 处读取一个定长的值，越界时返回 false
+template<typename T>
+static bool GetValue(const std::string &src, size_t &pos, T &value)
+{
+    if (pos + sizeof(T) > src.length())
+        return false;
+    memcpy(&value, src.c_str() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+static bool GetName(const std::string &src, size_t &pos, std::string &name)
+{
+    uint32_t len;
+    if (!GetValue(src, pos, len) || pos + len > src.length())
+        return false;
+    name = src.substr(pos, len);
+    pos += len;
+    return true;
+}
+
+Manifest::Manifest(const std::string &dir): dir(dir), failed(false)
+{
+    fd = ::open((dir + "/MANIFEST").c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+}
+
+Manifest::~Manifest()
+{
+    ::close(fd);
+}
+
+// 记录格式：校验和(4) + 长度(4) + last_time(8) + next_file_seq(8) + 新增个数(4) + 删除个数(4)
+// 每个新增文件：层数(4) + 时间戳(8) + 键值对数量(8) + 最小键(8) + 最大键(8) + 文件名
+// 每个删除文件：文件名；文件名均为 长度(4) + 相对于数据目录的路径
+void Manifest::Encode(const VersionEdit &edit, std::string &record) const
+{
+    record.assign(8, '\0');
+    PutValue(record, edit.last_time);
+    PutValue(record, edit.next_file_seq);
+    PutValue(record, (uint32_t) edit.added.size());
+    PutValue(record, (uint32_t) edit.deleted.size());
+
+    for (auto ptr : edit.added) {
+        std::string name = ptr->path.substr(dir.length() + 1);
+        PutValue(record, (int32_t) ptr->level);
+        PutValue(record, ptr->time);
+        PutValue(record, ptr->num);
+        PutValue(record, ptr->min);
+        PutValue(record, ptr->max);
+        PutValue(record, (uint32_t) name.length());
+        record.append(name);
+    }
+    for (auto ptr : edit.deleted) {
+        std::string name = ptr->path.substr(dir.length() + 1);
+        PutValue(record, (uint32_t) name.length());
+        record.append(name);
+    }
+
+    uint32_t len = record.length() - 8;
+    uint32_t crc = utils::crc32(&record[8], len);
+    memcpy(&record[0], &crc, sizeof(uint32_t));
+    memcpy(&record[4], &len, sizeof(uint32_t));
+}
+
+// 函数返回值 bool: 写入与 fsync 都成功时返回 true
+bool Manifest::Append(const VersionEdit &edit)
+{
+    if (failed || fd < 0)
+        return false;
+
+    std::string record;
+    Encode(edit, record);
+
+    size_t done = 0;
+    while (done < record.length()) {
+        ssize_t n = ::write(fd, record.c_str() + done, record.length() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            failed = true;
+            return false;
+        }
+        done += n;
+    }
+    if (utils::fsync(fd) != 0) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+void Manifest::WriteSnapshot(const Version &version, uint64_t last_time, uint64_t next_file_seq)
+{
+    VersionEdit edit;
+    edit.last_time = last_time;
+    edit.next_file_seq = next_file_seq;
+    for (int level = 0; level <= version.MaxLevel(); ++level) {
+        for (auto ptr : version.Files(level))
+            edit.added.push_back(ptr);
+    }
+
+    std::string record;
+    Encode(edit, record);
+
+    std::string tmp = dir + "/MANIFEST.tmp";
+    std::string path = dir + "/MANIFEST";
+    {
+        std::ofstream out(tmp, std::ios::out|std::ios::trunc|std::ios::binary);
+        out.write(record.c_str(), (long) record.length());
+    }
+    utils::syncFile(tmp.c_str());
+
+    // 改名是原子的：崩溃后看到的要么是旧的 MANIFEST，要么是完整的新 MANIFEST
+    ::close(fd);
+    std::rename(tmp.c_str(), path.c_str());
+    utils::syncFile(dir.c_str());
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+}
+
+bool Manifest::Recover(const std::string &dir, std::vector<sst_buf *> &files, uint64_t &last_time, uint64_t &next_file_seq)
+{
+    std::ifstream in(dir + "/MANIFEST", std::ios::binary|std::ios::in);
+    if (!in)
+        return false;
+
+    std::map<std::string, sst_buf *> live; // 按文件名索引的现存文件
+    last_time = 0;
+    next_file_seq = 1;
+
+    while (true) {
+        uint32_t crc, len;
+        if (!in.read((char*)&crc, sizeof(uint32_t)) || !in.read((char*)&len, sizeof(uint32_t)))
+            break;
+        if (len > (1U << 30)) // 长度字段本身已经损坏
+            break;
+
+        // 最后一条记录可能在写入时崩溃，校验失败说明它从未生效
+        std::string payload(len, '\0');
+        if (!in.read(&payload[0], len) || utils::crc32(payload.c_str(), len) != crc)
+            break;
+
+        size_t pos = 0;
+        uint64_t time, seq;
+        uint32_t n_added, n_deleted;
+        if (!GetValue(payload, pos, time) || !GetValue(payload, pos, seq) ||
+            !GetValue(payload, pos, n_added) || !GetValue(payload, pos, n_deleted))
+            break;
+        if (time > last_time)
+            last_time = time;
+        if (seq > next_file_seq)
+            next_file_seq = seq;
+
+        for (uint32_t i = 0; i < n_added; ++i) {
+            auto *add = new sst_buf;
+            int32_t level;
+            std::string name;
+            GetValue(payload, pos, level);
+            GetValue(payload, pos, add->time);
+            GetValue(payload, pos, add->num);
+            GetValue(payload, pos, add->min);
+            GetValue(payload, pos, add->max);
+            GetName(payload, pos, name);
+            add->level = level;
+            add->path = dir + "/" + name;
+
+            if (add->time > last_time)
+                last_time = add->time;
+            if (live.count(name))
+                delete live[name];
+            live[name] = add;
+        }
+        for (uint32_t i = 0; i < n_deleted; ++i) {
+            std::string name;
+            GetName(payload, pos, name);
+            auto it = live.find(name);
+            if (it != live.end()) {
+                delete it->second;
+                live.erase(it);
+            }
+        }
+    }
+
+    for (auto &item : live)
+        files.push_back(item.second);
+    return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "sstable.h"
+#include "version.h"
+
+// 对 SSTable 集合的一次修改，在 MANIFEST 中占一条记录，恢复时要么整体生效，要么整体被忽略
+struct VersionEdit {
+    std::vector<sst_buf *> added; // 新增的文件，只记录其元数据
+    std::vector<sst_buf *> deleted; // 被删除的文件
+    uint64_t last_time; // 已经使用过的最大时间戳
+    uint64_t next_file_seq; // 下一个新文件的序号
+
+    VersionEdit() {
+        last_time = 0;
+        next_file_seq = 0;
+    }
+};
+
+// 只追加的 MANIFEST 日志：每条记录为 校验和(4) + 长度(4) + 一次 VersionEdit
+// 新文件先落盘，再写入并 fsync 对应的记录，之后才能修改内存中的 Version 与删除旧文件，因此任意时刻崩溃都不会丢失数据
+// 重新打开时只需回放 MANIFEST 即可得到各层的文件，不必扫描目录
+class Manifest {
+private:
+    std::string dir;
+    int fd;
+    bool failed; // 某次追加失败之后，文件末尾可能是残缺的记录，恢复时其后的记录都会被忽略，不能再追加
+
+    void Encode(const VersionEdit &edit, std::string &record) const;
+
+public:
+    explicit Manifest(const std::string &dir);
+    ~Manifest();
+
+    // 写入一条记录，返回 true 时该记录已经持久化；返回 false 时该记录可能生效也可能不生效，调用者不能再修改 Version 或删除文件
+    bool Append(const VersionEdit &edit);
+
+    // 用当前全部文件构成的一条记录替换整个 MANIFEST（先写临时文件再改名），避免日志无限增长
+    void WriteSnapshot(const Version &version, uint64_t last_time, uint64_t next_file_seq);
+
+    // 回放目录下的 MANIFEST，得到现存文件的元数据（不含 Bloom Filter 与索引区），不存在 MANIFEST 时返回 false
+    static bool Recover(const std::string &dir, std::vector<sst_buf *> &files, uint64_t &last_time, uint64_t &next_file_seq);
+};
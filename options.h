@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+// WAL 的刷盘策略
+enum WALSyncMode
+{
+    SYNC_EVERY_WRITE = 1, // 每次写入后立即 fsync
+    SYNC_GROUP_COMMIT, // 并发的写者合并为一次 fsync
+    SYNC_PERIODIC // 写入操作系统缓存，由后台线程按固定间隔 fsync
+};
+
+// sst 文件数据块的压缩方式，数值记录在每个数据块的类型字节中
+enum CompressionType
+{
+    NO_COMPRESSION = 0,
+    LZ_COMPRESSION, // 内置的 LZ77 编码
+    ZLIB_COMPRESSION // 编译时找到 zlib 才可用
+};
+
+// 键值对的类型，记录在跳表结点、WAL 与 sst 文件中；删除标记不占用任何 value 字节
+// 旧版本以 value "~DELETED~" 表示删除，读取旧格式的 WAL 与 sst 文件时仍按删除处理
+enum ValueType
+{
+    TYPE_VALUE = 0,
+    TYPE_DELETION,
+    TYPE_RANGE_DELETION, // 只出现在 WAL 中：键为区间起点，value 为 8 字节的区间终点
+    TYPE_BATCH // 只出现在 WAL 中：一组写入合为一条记录，键为记录条数，value 为各条记录依次排列
+};
+
+#define LEGACY_DELETED_VALUE "~DELETED~"
+
+struct Options {
+    bool use_wal; // 是否在写入跳表之前先写 WAL
+    WALSyncMode wal_sync; // WAL 的刷盘策略
+    uint64_t wal_sync_interval; // SYNC_PERIODIC 的刷盘间隔（毫秒）
+    int flush_threads; // 后台落盘线程数
+    int compaction_threads; // 后台 compaction 线程数
+    int prefetch_threads; // 打开时并行预读 Bloom Filter 与索引区的线程数，为 0 时只在第一次访问时读入
+    int bloom_bits_per_key; // 新写出的 sst 文件中 Bloom Filter 为每个键分配的比特数，哈希次数随之确定
+    uint32_t block_size; // 新写出的 sst 文件中数据块的目标字节数，内存中每块只保留一个索引项；为 0 时每个键都有索引项
+    bool elias_fano_index; // 分块格式的索引区是否用 Elias-Fano 编码各块的最大键
+    CompressionType compression; // 分块格式中数据块的压缩方式
+    double compression_ratio; // 压缩后不超过原大小的该比例才保存压缩结果，否则原样保存
+    int max_open_files; // 保持打开的 sst 文件数上限，超过时关闭最久未使用的文件
+    bool use_mmap; // 打开的 sst 文件是否整体 mmap，否则保留文件描述符用 pread 读取
+    uint64_t block_cache_size; // 解压后数据块的缓存容量（字节），为 0 时不缓存
+    uint64_t row_cache_size; // 热点键的 value 缓存容量（字节），跳表中没有的键命中时 get 不再查找 SSTable；为 0 时不开启
+
+    Options() {
+        use_wal = true;
+        wal_sync = SYNC_PERIODIC;
+        wal_sync_interval = 100;
+        flush_threads = 1;
+        compaction_threads = 2;
+        prefetch_threads = 4;
+        bloom_bits_per_key = 10;
+        block_size = 4096;
+        elias_fano_index = true;
+        compression = LZ_COMPRESSION;
+        compression_ratio = 0.875;
+        max_open_files = 1000;
+        use_mmap = true;
+        block_cache_size = 8 * 1024 * 1024;
+        row_cache_size = 0;
+    }
+};
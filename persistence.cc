@@ -8,6 +8,21 @@
 class PersistenceTest : public Test {
 private:
 	const uint64_t TEST_MAX = 1024 * 32;
+	const uint64_t RANGE_BASE = 1024 * 64;
+	const uint64_t RANGE_MAX = 1024;
+
+	// Value of RANGE_BASE + i after both range deletions and the put in between
+	std::string range_value(uint64_t i)
+	{
+		if (i == RANGE_MAX / 2)
+			return std::string(i+1, 'u');
+		if (i >= RANGE_MAX / 4 && i <= RANGE_MAX / 4 * 3)
+			return not_found;
+		if (i >= RANGE_MAX / 8 * 7)
+			return not_found;
+		return std::string(i+1, 'r');
+	}
+
 	void prepare(uint64_t max)
 	{
 		uint64_t i;
@@ -67,6 +82,15 @@ private:
 
 		phase();
 
+		// Prepare range deletions: the first one is drained to disk below,
+		// the second one is still in memory when the program is killed
+		for (i = 0; i < RANGE_MAX; ++i)
+			store.put(RANGE_BASE + i, std::string(i+1, 'r'));
+		store.delete_range(RANGE_BASE + RANGE_MAX / 4,
+				   RANGE_BASE + RANGE_MAX / 4 * 3);
+		store.put(RANGE_BASE + RANGE_MAX / 2,
+			  std::string(RANGE_MAX / 2 + 1, 'u'));
+
 		report();
 
 		/**
@@ -77,6 +101,9 @@ private:
             std::cout << "5 => " << i << std::endl;
         }
 
+		store.delete_range(RANGE_BASE + RANGE_MAX / 8 * 7,
+				   RANGE_BASE + RANGE_MAX - 1);
+
 		std::cout << "Data is ready, please press ctrl-c/ctrl-d to"
 			" terminate this program!" << std::endl;
 		std::cout.flush();
@@ -126,6 +153,10 @@ private:
 			}
 		}
 
+		// Test range deletions, both from SSTables and replayed from the WAL
+		for (i = 0; i < RANGE_MAX; ++i)
+			EXPECT(range_value(i), store.get(RANGE_BASE + i));
+
 		phase();
 
 		report();
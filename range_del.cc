@@ -0,0 +1,99 @@
+#include "range_del.h"
+#include <algorithm>
+
+const RangeTombstone *FindRangeTombstone(const std::vector<RangeTombstone> &tombstones, uint64_t key)
+{
+    auto it = std::upper_bound(tombstones.begin(), tombstones.end(), key, [](uint64_t key, const RangeTombstone &t) {
+        return key < t.begin;
+    });
+    if (it == tombstones.begin())
+        return nullptr;
+    -- it;
+    return key <= it->end ? &*it : nullptr;
+}
+
+// 函数参数 seq: 本次删除的写入序号，大于跳表中已有的全部序号
+// 函数功能：移除被 [begin, end] 完全覆盖的旧段，截断两端部分重叠的旧段，再插入新段
+void RangeTombstoneList::Add(uint64_t begin, uint64_t end, uint64_t seq)
+{
+    // 起点在 begin 之前、与新段重叠的旧段：保留 begin 之前的部分，越过 end 的部分另成一段
+    auto it = fragments.lower_bound(begin);
+    if (it != fragments.begin()) {
+        auto prev = std::prev(it);
+        RangeTombstone &t = prev->second;
+        if (t.end >= begin) {
+            if (t.end > end)
+                fragments.emplace(end + 1, RangeTombstone(end + 1, t.end, t.seq));
+            t.end = begin - 1;
+        }
+    }
+
+    // 起点落在新段之内的旧段：越过 end 的部分保留
+    while (it != fragments.end() && it->first <= end) {
+        RangeTombstone t = it->second;
+        it = fragments.erase(it);
+        if (t.end > end) {
+            fragments.emplace(end + 1, RangeTombstone(end + 1, t.end, t.seq));
+            break;
+        }
+    }
+
+    fragments.emplace(begin, RangeTombstone(begin, end, seq));
+}
+
+const RangeTombstone *RangeTombstoneList::Find(uint64_t key) const
+{
+    auto it = fragments.upper_bound(key);
+    if (it == fragments.begin())
+        return nullptr;
+    -- it;
+    return key <= it->second.end ? &it->second : nullptr;
+}
+
+// 函数功能：按 begin 升序输出全部段
+void RangeTombstoneList::Fragments(std::vector<RangeTombstone> &out) const
+{
+    for (auto &entry : fragments)
+        out.push_back(entry.second);
+}
+
+void RangeDeletions::Add(int level, uint64_t time, std::vector<RangeTombstone> tombstones)
+{
+    if (!tombstones.empty())
+        sources.push_back(Source{level, time, std::move(tombstones)});
+}
+
+// 函数参数 level/time/seq: 键值对所在的数据源与写入序号（sst 文件中为 0）
+// 函数返回值 bool: 是否有更新的范围删除标记覆盖 key
+bool RangeDeletions::Covers(uint64_t key, int level, uint64_t time, uint64_t seq) const
+{
+    for (auto &source : sources) {
+        if (source.level > level || (source.level == level && source.time < time))
+            continue; // 更旧的数据源
+        const RangeTombstone *t = FindRangeTombstone(source.tombstones, key);
+        if (t == nullptr)
+            continue;
+        if (source.level != level || source.time != time || t->seq > seq)
+            return true;
+    }
+    return false;
+}
+
+// 函数功能：全部数据源的段的并集，合并为按 begin 升序、互不重叠也不相邻的段，序号为 0
+void RangeDeletions::Union(std::vector<RangeTombstone> &out) const
+{
+    std::vector<RangeTombstone> all;
+    for (auto &source : sources)
+        all.insert(all.end(), source.tombstones.begin(), source.tombstones.end());
+    std::sort(all.begin(), all.end(), [](const RangeTombstone &a, const RangeTombstone &b) {
+        return a.begin < b.begin;
+    });
+
+    out.clear();
+    for (auto &t : all) {
+        if (!out.empty() && (out.back().end == UINT64_MAX || t.begin <= out.back().end + 1))
+            out.back().end = std::max(out.back().end, t.end);
+        else
+            out.emplace_back(t.begin, t.end, 0);
+    }
+}
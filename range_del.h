@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// 范围删除标记的一段：删除 [begin, end] 中比它旧的全部键值对
+// 同一来源（一个跳表或一个 sst 文件）中的各段按 begin 升序排列、互不重叠
+// 跳表中的段记录覆盖它的最新一次 delete_range 的写入序号，只删除同一跳表中序号更小的键值对；
+// sst 文件中的段为 0，落盘与 compaction 时已经丢弃被覆盖的键值对，因此只删除更旧的文件中的键值对
+struct RangeTombstone {
+    uint64_t begin;
+    uint64_t end; // 包含 end
+    uint64_t seq;
+
+    RangeTombstone(uint64_t begin, uint64_t end, uint64_t seq): begin(begin), end(end), seq(seq) {}
+};
+
+// 函数返回值 const RangeTombstone*: 升序且互不重叠的 tombstones 中包含 key 的一段，没有时为 nullptr
+const RangeTombstone *FindRangeTombstone(const std::vector<RangeTombstone> &tombstones, uint64_t key);
+
+// 跳表中的范围删除标记：以 begin 为键的互不重叠的段，新的删除覆盖区间内的旧段，两端部分重叠的旧段被截断
+// 每次 delete_range 至多增加两段，代价只与被它完全覆盖的旧段个数有关，与区间宽度无关
+class RangeTombstoneList {
+private:
+    std::map<uint64_t, RangeTombstone> fragments;
+
+public:
+    void Add(uint64_t begin, uint64_t end, uint64_t seq);
+    const RangeTombstone *Find(uint64_t key) const;
+    bool Empty() const {return fragments.empty();}
+    uint64_t Count() const {return fragments.size();}
+    void Fragments(std::vector<RangeTombstone> &out) const;
+};
+
+// 迭代器与 compaction 使用的范围删除视图：收集各个数据源的段，判断某个数据源中的键值对是否被更新的数据源删除
+// 数据源的新旧与 MergingIterator 一致：层数小者更新，同一层中时间戳大者更新，同一数据源中比较写入序号
+class RangeDeletions {
+private:
+    struct Source {
+        int level;
+        uint64_t time;
+        std::vector<RangeTombstone> tombstones;
+    };
+
+    std::vector<Source> sources;
+
+public:
+    void Add(int level, uint64_t time, std::vector<RangeTombstone> tombstones);
+    bool Empty() const {return sources.empty();}
+    bool Covers(uint64_t key, int level, uint64_t time, uint64_t seq) const;
+    void Union(std::vector<RangeTombstone> &out) const;
+};
@@ -0,0 +1,113 @@
+#include "row_cache.h"
+
+RowCache::RowCache(uint64_t capacity): hits(0), misses(0)
+{
+    for (auto &shard : shards) {
+        shard.capacity = capacity >> ROW_CACHE_SHARD_BITS;
+        shard.usage = 0;
+        shard.generation = 0;
+    }
+}
+
+// 调用者持有 shard.mutex
+void RowCache::Remove(Shard &shard, std::list<Entry>::iterator pos)
+{
+    shard.usage -= Charge(*pos);
+    shard.table.erase(pos->key);
+    shard.lru.erase(pos);
+}
+
+// 函数返回值 bool: 命中时返回 true，type 为缓存的类型，val 为对应的 value
+bool RowCache::Lookup(uint64_t key, std::string &val, ValueType &type)
+{
+    Shard &shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.table.find(key);
+    if (it == shard.table.end()) {
+        misses ++ ;
+        return false;
+    }
+    hits ++ ;
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    type = it->second->type;
+    val = it->second->val;
+    return true;
+}
+
+// 函数返回值 uint64_t: key 所在分片目前的代数，调用者需要与写入互斥地读取（持有 KVStore 的 mutex）
+uint64_t RowCache::Generation(uint64_t key)
+{
+    Shard &shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    return shard.generation;
+}
+
+// 函数参数 generation: 查找开始时 Generation 的返回值，此后有过写入时不插入
+// 函数功能：插入或更新 key，并从最久未使用的一端淘汰到不超过容量；单个超过分片容量的 value 不缓存
+void RowCache::Insert(uint64_t key, const std::string &val, ValueType type, uint64_t generation)
+{
+    Shard &shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.generation != generation)
+        return;
+
+    auto it = shard.table.find(key);
+    if (it != shard.table.end())
+        Remove(shard, it->second);
+
+    shard.lru.emplace_front(key, type, type == TYPE_DELETION ? std::string() : val);
+    if (Charge(shard.lru.front()) > shard.capacity) {
+        shard.lru.pop_front();
+        return;
+    }
+    shard.usage += Charge(shard.lru.front());
+    shard.table[key] = shard.lru.begin();
+    while (shard.usage > shard.capacity)
+        Remove(shard, std::prev(shard.lru.end()));
+}
+
+// 函数功能：写入 key 时调用，移除缓存的旧值，并使正在进行的 get 放弃插入
+void RowCache::Erase(uint64_t key)
+{
+    Shard &shard = ShardOf(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.generation ++ ;
+    auto it = shard.table.find(key);
+    if (it != shard.table.end())
+        Remove(shard, it->second);
+}
+
+// 函数功能：delete_range 时调用，移除区间内的全部键并使各分片中正在进行的 get 放弃插入；代价与缓存的键数有关，与区间宽度无关
+void RowCache::EraseRange(uint64_t begin, uint64_t end)
+{
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.generation ++ ;
+        for (auto it = shard.lru.begin(); it != shard.lru.end(); ) {
+            auto cur = it ++ ;
+            if (begin <= cur->key && cur->key <= end)
+                Remove(shard, cur);
+        }
+    }
+}
+
+void RowCache::Clear()
+{
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.generation ++ ;
+        shard.lru.clear();
+        shard.table.clear();
+        shard.usage = 0;
+    }
+}
+
+uint64_t RowCache::Usage()
+{
+    uint64_t total = 0;
+    for (auto &shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        total += shard.usage;
+    }
+    return total;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "options.h"
+
+#define ROW_CACHE_SHARD_BITS 4
+
+// 热点键的缓存：键到 get 在 SSTable 中找到的 value 或删除标记，容量按字节计算，平均分给各个分片，超出时按 LRU 淘汰
+// 写入时 Erase 对应的键并使所在分片的代数加一；get 在确认跳表中没有该键时记下代数，在 SSTable 中找到后带着它 Insert，
+// 期间同一分片发生过写入则放弃插入，避免并发写入之前读到的旧值覆盖新值
+class RowCache {
+private:
+    struct Entry {
+        uint64_t key;
+        ValueType type;
+        std::string val; // 删除标记为空
+
+        Entry(uint64_t key, ValueType type, const std::string &val): key(key), type(type), val(val) {}
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        uint64_t capacity;
+        uint64_t usage;
+        uint64_t generation; // 该分片的写入次数
+        std::list<Entry> lru; // 最近使用的在前
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> table;
+    };
+
+    Shard shards[1 << ROW_CACHE_SHARD_BITS];
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+
+    Shard &ShardOf(uint64_t key) {return shards[(key * 0x9e3779b97f4a7c15ULL) >> (64 - ROW_CACHE_SHARD_BITS)];}
+    static uint64_t Charge(const Entry &entry) {return sizeof(Entry) + entry.val.capacity() + 32;} // 另计链表与哈希表节点的开销
+    static void Remove(Shard &shard, std::list<Entry>::iterator pos);
+
+public:
+    explicit RowCache(uint64_t capacity);
+
+    bool Lookup(uint64_t key, std::string &val, ValueType &type);
+    uint64_t Generation(uint64_t key);
+    void Insert(uint64_t key, const std::string &val, ValueType type, uint64_t generation);
+    void Erase(uint64_t key);
+    void EraseRange(uint64_t begin, uint64_t end);
+    void Clear();
+    uint64_t Hits() const {return hits;}
+    uint64_t Misses() const {return misses;}
+    uint64_t Usage();
+};
@@ -0,0 +1,66 @@
+#include "scheduler.h"
+
+ThreadPool::ThreadPool(int threads): active(0), seq(0), stop(false)
+{
+    for (int i = 0; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::Worker, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::Schedule(std::function<void()> fn, int priority)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push(Job{priority, seq++, std::move(fn)});
+    }
+    cv.notify_one();
+}
+
+void ThreadPool::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!jobs.empty() || active > 0)
+        idle_cv.wait(lock);
+}
+
+void ThreadPool::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    while (!jobs.empty())
+        jobs.pop();
+    if (active == 0)
+        idle_cv.notify_all();
+}
+
+void ThreadPool::Worker()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        while (jobs.empty() && !stop)
+            cv.wait(lock);
+        if (jobs.empty())
+            break;
+
+        std::function<void()> fn = jobs.top().fn;
+        jobs.pop();
+        active ++ ;
+        lock.unlock();
+
+        fn(); // 任务执行期间可能继续向本线程池提交新的任务
+
+        lock.lock();
+        active -- ;
+        if (jobs.empty() && active == 0)
+            idle_cv.notify_all();
+    }
+}
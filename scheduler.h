@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// 固定线程数的线程池，任务按优先级执行（数值越大越先执行），同一优先级先进先出
+class ThreadPool {
+private:
+    struct Job {
+        int priority;
+        uint64_t seq;
+        std::function<void()> fn;
+    };
+
+    struct Compare {
+        bool operator()(const Job &a, const Job &b) const {
+            if (a.priority != b.priority)
+                return a.priority < b.priority;
+            return a.seq > b.seq;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    std::priority_queue<Job, std::vector<Job>, Compare> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::condition_variable idle_cv;
+    int active; // 正在执行的任务个数
+    uint64_t seq;
+    bool stop;
+
+    void Worker();
+
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool(); // 执行完队列中剩余的任务后退出
+
+    void Schedule(std::function<void()> fn, int priority = 0);
+    void WaitIdle(); // 等待队列为空并且没有正在执行的任务
+    void Clear(); // 丢弃尚未开始执行的任务
+};
+
+// 后台调度器：落盘与 compaction 使用各自独立的线程池，落盘永远不会排在 compaction 之后
+// 打开时预读 SSTable 的任务使用第三个线程池，线程数为 0 时不预读
+class Scheduler {
+private:
+    ThreadPool flush_pool;
+    ThreadPool compaction_pool;
+    ThreadPool prefetch_pool;
+    bool prefetch;
+
+public:
+    Scheduler(int flush_threads, int compaction_threads, int prefetch_threads)
+        : flush_pool(flush_threads), compaction_pool(compaction_threads), prefetch_pool(prefetch_threads),
+          prefetch(prefetch_threads > 0) {}
+
+    void ScheduleFlush(std::function<void()> fn) {flush_pool.Schedule(std::move(fn));}
+    void ScheduleCompaction(std::function<void()> fn, int priority) {compaction_pool.Schedule(std::move(fn), priority);}
+    void SchedulePrefetch(std::function<void()> fn) {
+        if (prefetch)
+            prefetch_pool.Schedule(std::move(fn));
+    }
+
+    // 落盘可能产生新的 compaction，因此先等待落盘线程池
+    void WaitIdle() {
+        flush_pool.WaitIdle();
+        compaction_pool.WaitIdle();
+        prefetch_pool.WaitIdle();
+    }
+    void WaitCompactions() {compaction_pool.WaitIdle();}
+
+    // 预读任务持有 SSTable 缓冲区的指针，释放缓冲区之前必须等待预读结束
+    void WaitPrefetch() {prefetch_pool.WaitIdle();}
+    void CancelPrefetch() {prefetch_pool.Clear();}
+};
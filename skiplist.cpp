@@ -1,92 +1,349 @@
-#include <iostream>
-#include <stdlib.h>
-
-#include "skiplist.h"
-
-double SkipList::my_rand()
-{
-    s = (16807 * s) % 2147483647ULL;
-    return (s + 0.0) / 2147483647ULL;
-}
-
-int SkipList::randomLevel()
-{
-    int result = 1;
-    while (result < MAX_LEVEL && my_rand() < 0.5)
-    {
-        ++result;
-    }
-    return result;
-}
-
-void SkipList::Insert(uint64_t key, std::string value)
-{
-    SKNode* travel = head;
-    int level = MAX_LEVEL - 1;
-
-    SKNode* update[MAX_LEVEL];
-    for (int i=0; i<MAX_LEVEL; ++i)
-        update[i] = head;
-
-    for ( ; level>=0; level--) {
-        while ((travel->forwards[level] != NIL) && (travel->forwards[level]->key < key)) {
-            travel = travel->forwards[level];
-            for (int i = level; i >= 0 ; --i) {
-                update[i] = travel;
-            }
-        }
-    }
-
-    if (travel->forwards[0]->key == key) {
-        dataLength -= (int) (travel->forwards[0]->val).length();
-        travel->forwards[0]->val = value;
-        dataLength += (int) value.length();
-        return;
-    } // deal with the case of updating
-
-    int new_level = randomLevel();
-    auto* new_node = new SKNode(key, value, NORMAL); // really needs to insert
-    for (int i = 0; i < new_level; ++i) {
-        new_node->forwards[i] = update[i]->forwards[i];
-        update[i]->forwards[i] = new_node;
-    }
-
-    dataLength += 12 + (int) value.length();
-}
-
-bool SkipList::Search(uint64_t key, std::string &str_ptr) const
-{
-    SKNode* travel = head;
-    int level = MAX_LEVEL - 1;
-
-    for ( ; level>=0; level--)
-        while ((travel->forwards[level] != NIL) && (travel->forwards[level]->key < key)) {
-            travel = travel->forwards[level];
-        }
-
-    travel = travel->forwards[0];
-
-    if (travel->key == key) {
-        str_ptr = travel->val;
-        return true;
-    }
-    else {
-        return false;
-    }
-}
-
-void SkipList::Display()
-{
-    for (int i = MAX_LEVEL - 1; i >= 0; --i)
-    {
-        std::cout << "Level " << i + 1 << ":h";
-        SKNode *node = head->forwards[i];
-        while (node->type != SKNodeType::NIL)
-        {
-            std::cout << "-->(" << node->key << "," << node->val << ")";
-            node = node->forwards[i];
-        }
-
-        std::cout << "-->N" << std::endl;
-    }
-}
+#include <iostream>
+#include <stdlib.h>
+
+#include "skiplist.h"
+#include <cstring>
+#include <new>
+#include <thread>
+
+SkipList::SkipList(): dataLength(48), count(0), wasted(0), last_seq(0), visible(0), writing(0), pending(0), pending_bytes(0), has_ranges(false)
+{
+    head = NewNode(0, "", SKNodeType::HEAD, TYPE_VALUE, 0, MAX_LEVEL);
+    NIL = NewNode(ULONG_LONG_MAX, "", SKNodeType::NIL, TYPE_VALUE, 0, 1);
+    for (int i = 0; i < MAX_LEVEL; ++i)
+    {
+        head->forwards[i].store(NIL, std::memory_order_relaxed);
+    }
+}
+
+// 函数功能：在内存池中分配高度为 height 的结点，第一版 value 紧随指针塔之后
+SKNode *SkipList::NewNode(uint64_t key, const std::string &value, SKNodeType type, ValueType value_type, uint64_t seq, int height)
+{
+    size_t size = sizeof(SKNode) + sizeof(std::atomic<SKNode *>) * (height - 1);
+    char *mem = arena.AllocateAligned(size + sizeof(SKValue) + value.length());
+    auto *node = new (mem) SKNode;
+    node->key = key;
+    node->type = type;
+    node->height = (uint8_t) height;
+    for (int i = 0; i < height; ++i)
+        node->forwards[i].store(nullptr, std::memory_order_relaxed);
+
+    auto *v = new (mem + size) SKValue;
+    v->seq = seq;
+    v->prev.store(nullptr, std::memory_order_relaxed);
+    v->len = (uint32_t) value.length();
+    v->type = value_type;
+    memcpy(mem + size + sizeof(SKValue), value.data(), value.length());
+    node->value.store(v, std::memory_order_relaxed);
+    return node;
+}
+
+SKValue *SkipList::NewValue(const std::string &value, ValueType value_type, uint64_t seq)
+{
+    char *mem = arena.AllocateAligned(sizeof(SKValue) + value.length());
+    auto *v = new (mem) SKValue;
+    v->seq = seq;
+    v->prev.store(nullptr, std::memory_order_relaxed);
+    v->len = (uint32_t) value.length();
+    v->type = value_type;
+    memcpy(mem + sizeof(SKValue), value.data(), value.length());
+    return v;
+}
+
+// 每个线程各自的随机数状态，并发的写者互不干扰
+int SkipList::randomLevel()
+{
+    static std::atomic<unsigned long long> seed(1);
+    thread_local unsigned long long s = seed.fetch_add(1) * 48271 % 2147483647ULL;
+
+    int result = 1;
+    while (result < MAX_LEVEL)
+    {
+        s = (16807 * s) % 2147483647ULL;
+        if ((s + 0.0) / 2147483647ULL >= 0.5)
+            break;
+        ++result;
+    }
+    return result;
+}
+
+// 函数参数 prev: 不为 nullptr 时记录每一层中最后一个键小于 key 的结点
+// 函数返回值 SKNode*: 第一个键不小于 key 的结点，没有时为 NIL
+SKNode *SkipList::FindGreaterOrEqual(uint64_t key, SKNode **prev) const
+{
+    SKNode *travel = head;
+    SKNode *next = NIL;
+    for (int level = MAX_LEVEL - 1; level >= 0; level--) {
+        next = travel->Next(level);
+        while (next != NIL && next->key < key) {
+            travel = next;
+            next = travel->Next(level);
+        }
+        if (prev != nullptr)
+            prev[level] = travel;
+    }
+    return next;
+}
+
+// 函数功能：单独作为一个写者插入一个键值对，插入后立即公开
+void SkipList::Insert(uint64_t key, const std::string &value, ValueType value_type)
+{
+    int bytes = 12 + (int) value.length();
+    uint64_t seq = BeginWrite(1, 1, bytes);
+    Insert(key, value, value_type, seq);
+    Publish(seq);
+    EndWrite(1, bytes);
+}
+
+// 函数参数 value_type: 为 TYPE_DELETION 时 value 为空，只占用索引项的 12 字节
+// 函数参数 seq: 由 BeginWrite 分配的写入序号
+// 函数功能：自底向上逐层用 CAS 链入新结点，某一层失败时从该层的前驱重新查找位置；
+// 最底层落败给同一个键的并发插入时改为更新那个结点，已经链入最底层之后其他写者只会找到这个结点
+void SkipList::Insert(uint64_t key, const std::string &value, ValueType value_type, uint64_t seq)
+{
+    SKNode *prev[MAX_LEVEL];
+    SKNode *next = FindGreaterOrEqual(key, prev);
+    if (next->key == key) {
+        Update(next, value, value_type, seq);
+        return;
+    } // deal with the case of updating
+
+    int new_level = randomLevel();
+    SKNode *new_node = NewNode(key, value, NORMAL, value_type, seq, new_level); // really needs to insert
+    for (int i = 0; i < new_level; ++i) {
+        while (true) {
+            next = prev[i]->Next(i);
+            while (next != NIL && next->key < key) {
+                prev[i] = next;
+                next = prev[i]->Next(i);
+            }
+            if (i == 0 && next->key == key) {
+                wasted += (int) (sizeof(SKNode) + sizeof(std::atomic<SKNode *>) * (new_level - 1) + sizeof(SKValue) + value.length());
+                Update(next, value, value_type, seq);
+                return;
+            }
+            new_node->forwards[i].store(next, std::memory_order_relaxed);
+            if (prev[i]->forwards[i].compare_exchange_strong(next, new_node, std::memory_order_release))
+                break;
+        }
+    }
+
+    dataLength += 12 + (int) value.length();
+    count ++ ;
+}
+
+// 函数功能：以序号更大的新版本替换结点的 value，旧版本留在版本链中；已有更新的版本时按序号插入版本链的中间，
+// 只有尚未看到那个更新版本的读者才会读到它。被替换或插入中间的版本最终不会落盘，计入 wasted
+void SkipList::Update(SKNode *node, const std::string &value, ValueType value_type, uint64_t seq)
+{
+    SKValue *v = NewValue(value, value_type, seq);
+    SKValue *old = node->value.load(std::memory_order_acquire);
+    while (old->seq < seq) {
+        v->prev.store(old, std::memory_order_relaxed);
+        if (node->value.compare_exchange_weak(old, v, std::memory_order_acq_rel)) {
+            wasted += (int) old->Size();
+            dataLength += (int) value.length() - (int) old->len;
+            return;
+        }
+    }
+
+    SKValue *newer = old;
+    while (true) {
+        SKValue *older = newer->prev.load(std::memory_order_acquire);
+        if (older != nullptr && older->seq > seq) {
+            newer = older;
+            continue;
+        }
+        v->prev.store(older, std::memory_order_relaxed);
+        if (newer->prev.compare_exchange_weak(older, v, std::memory_order_acq_rel))
+            break;
+    }
+    wasted += (int) v->Size();
+}
+
+// 函数返回值 const SKValue*: 结点序号不超过 snapshot 的最新版本，没有时为 nullptr
+const SKValue *SkipList::Visible(const SKNode *node, uint64_t snapshot)
+{
+    const SKValue *v = node->Value();
+    while (v != nullptr && v->seq > snapshot)
+        v = v->prev.load(std::memory_order_acquire);
+    return v;
+}
+
+// 函数参数 tombstone: 存放覆盖 key 的范围删除的序号，没有时不变
+// 函数返回值 uint64_t: 读者的快照，tombstone 与之一致：此时已经应用的范围删除都已公开
+uint64_t SkipList::Snapshot(uint64_t key, uint64_t &tombstone) const
+{
+    uint64_t snapshot = visible;
+    if (!has_ranges)
+        return snapshot; // 应用范围删除先于推进 visible，快照之前公开的写入中没有范围删除
+    std::lock_guard<std::mutex> lock(mutex);
+    const RangeTombstone *t = range_tombstones.Find(key);
+    if (t != nullptr)
+        tombstone = t->seq;
+    return visible;
+}
+
+// 函数功能：在已经公开的写入中查找 key
+bool SkipList::Search(uint64_t key, std::string &str_ptr, ValueType &value_type) const
+{
+    uint64_t tombstone = 0;
+    uint64_t snapshot = Snapshot(key, tombstone);
+    SKNode *travel = FindGreaterOrEqual(key, nullptr);
+
+    const SKValue *v = travel->key == key ? Visible(travel, snapshot) : nullptr;
+    if (v != nullptr && v->seq > tombstone) {
+        str_ptr.assign(v->Data(), v->len);
+        value_type = v->type;
+        return true;
+    }
+
+    // 被同一跳表中更晚的范围删除覆盖，或者跳表中没有该键但有覆盖它的范围删除：都视为删除标记，遮盖更旧的 SSTable
+    if (tombstone > 0) {
+        str_ptr.clear();
+        value_type = TYPE_DELETION;
+        return true;
+    }
+    return false;
+}
+
+// 函数功能：单独作为一个写者删除 [begin, end]，立即公开
+void SkipList::DeleteRange(uint64_t begin, uint64_t end)
+{
+    uint64_t seq = BeginWrite(1, 0, 4 + 2 * 16);
+    DeleteRange(begin, end, seq);
+    Publish(seq);
+    EndWrite(0, 4 + 2 * 16);
+}
+
+// 函数功能：删除 [begin, end] 中序号小于 seq 的全部键值对，只记录一段范围删除标记，不访问区间内的结点
+// 所在的写者公开时才加入 range_tombstones，在此之前读者看不到它
+void SkipList::DeleteRange(uint64_t begin, uint64_t end, uint64_t seq)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (seq > visible) {
+        auto it = inflight.upper_bound(seq);
+        --it;
+        it->second.ranges.emplace_back(begin, end, seq);
+        return;
+    }
+    ApplyRange(RangeTombstone(begin, end, seq));
+}
+
+// 调用者持有 mutex：落盘时每段占用 16 字节，段数的变化计入 sst 文件的长度
+void SkipList::ApplyRange(const RangeTombstone &t)
+{
+    uint64_t before = range_tombstones.Count();
+    range_tombstones.Add(t.begin, t.end, t.seq);
+    has_ranges = true;
+    if (before == 0)
+        dataLength += 4; // 段数
+    dataLength += 16 * ((int) range_tombstones.Count() - (int) before);
+}
+
+// 函数功能：按 begin 升序复制全部段
+// 函数返回值 uint64_t: 与复制的段一致的快照，游标只看序号不超过它的版本
+uint64_t SkipList::RangeFragments(std::vector<RangeTombstone> &out) const
+{
+    uint64_t snapshot = visible;
+    if (!has_ranges)
+        return snapshot;
+    std::lock_guard<std::mutex> lock(mutex);
+    range_tombstones.Fragments(out);
+    return visible;
+}
+
+// 函数返回值 bool: 结点的 value 是否被同一跳表中更晚的范围删除覆盖
+bool SkipList::Covered(const SKNode *node, const SKValue *value) const
+{
+    if (!has_ranges)
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    const RangeTombstone *t = range_tombstones.Find(node->key);
+    return t != nullptr && t->seq > value->seq;
+}
+
+// 函数返回值 uint64_t: 分配的第一个序号，其余依次加一
+// 调用者之间的登记顺序就是序号的顺序，也是公开的顺序
+uint64_t SkipList::BeginWrite(int records, int entries, int bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t seq = last_seq + 1;
+    last_seq += records;
+    InflightWrite &w = inflight[seq];
+    w.last = last_seq;
+    w.done = false;
+    pending_bytes += bytes;
+    pending += entries;
+    writing ++ ;
+    return seq;
+}
+
+// 函数功能：seq 开始的写者已经插入全部记录；序号更小的写者都已公开时一并公开，应用其中的范围删除后推进 visible
+// 返回时这个写者已经公开，此后它自己的读取一定能看到这次写入
+void SkipList::Publish(uint64_t seq)
+{
+    uint64_t last;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto mine = inflight.find(seq);
+        mine->second.done = true;
+        last = mine->second.last;
+        while (!inflight.empty() && inflight.begin()->second.done) {
+            auto it = inflight.begin();
+            for (auto &t : it->second.ranges)
+                ApplyRange(t);
+            visible = it->second.last;
+            inflight.erase(it);
+        }
+    }
+
+    // 序号更小的写者仍在插入，由它公开时一并公开
+    while (visible < last)
+        std::this_thread::yield();
+}
+
+// 函数功能：等待已经登记的写者全部完成，此后跳表不再变化，全部写入都已公开
+void SkipList::WaitForWriters() const
+{
+    while (writing > 0)
+        std::this_thread::yield();
+}
+
+SKNode *SkipList::Seek(uint64_t key) const
+{
+    return FindGreaterOrEqual(key, nullptr);
+}
+
+void SkipList::Display()
+{
+    for (int i = MAX_LEVEL - 1; i >= 0; --i)
+    {
+        std::cout << "Level " << i + 1 << ":h";
+        SKNode *node = head->Next(i);
+        while (node->type != SKNodeType::NIL)
+        {
+            const SKValue *v = node->Value();
+            std::cout << "-->(" << node->key << "," << std::string(v->Data(), v->len) << ")";
+            node = node->Next(i);
+        }
+
+        std::cout << "-->N" << std::endl;
+    }
+}
+
+void SkipListIterator::Load()
+{
+    current = nullptr;
+    while (node->type != SKNodeType::NIL && (current = SkipList::Visible(node, snapshot)) == nullptr)
+        node = node->Next(0);
+}
+
+const std::string &SkipListIterator::value() const
+{
+    if (loaded != current) {
+        val.assign(current->Data(), current->len);
+        loaded = current;
+    }
+    return val;
+}
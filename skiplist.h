@@ -1,71 +1,152 @@
-#pragma once
-
-#include <vector>
-#include <climits>
-#include <ctime>
-#include <cstdlib>
-#include "kvstore_api.h"
-#include <iostream>
-
-#define MAX_LEVEL 8
-
-enum SKNodeType
-{
-    HEAD = 1,
-    NORMAL,
-    NIL
-};
-
-struct SKNode
-{
-    uint64_t key;
-    std::string val;
-    SKNodeType type;
-    std::vector<SKNode *> forwards;
-    SKNode(uint64_t _key, std::string _val, SKNodeType _type)
-            : key(_key), val(_val), type(_type)
-    {
-        for (int i = 0; i < MAX_LEVEL; ++i)
-        {
-            forwards.push_back(nullptr);
-        }
-    }
-};
-
-class SkipList
-{
-private:
-    unsigned long long s = 1;
-    double my_rand();
-    int randomLevel();
-    int dataLength = 10272;  // 当前跳表转化为 sst 文件的基础长度
-
-public:
-    SKNode *head;
-    SKNode *NIL;
-    SkipList()
-    {
-        head = new SKNode(0, "", SKNodeType::HEAD);
-        NIL = new SKNode(ULONG_LONG_MAX, "", SKNodeType::NIL);
-        for (int i = 0; i < MAX_LEVEL; ++i)
-        {
-            head->forwards[i] = NIL;
-        }
-    }
-    void Insert(uint64_t key, std::string value);
-    bool Search(uint64_t key, std::string &str_ptr) const;
-    void Display();
-    int GetCurrentDataLength() const {return dataLength;}
-    void CleanDataLength() {dataLength = 10272;}
-    ~SkipList()
-    {
-        SKNode *n1 = head;
-        SKNode *n2;
-        while (n1)
-        {
-            n2 = n1->forwards[0];
-            delete n1;
-            n1 = n2;
-        }
-    }
-};
+#pragma once
+
+#include <vector>
+#include <climits>
+#include <ctime>
+#include <cstdlib>
+#include "kvstore_api.h"
+#include "iterator.h"
+#include "options.h"
+#include "range_del.h"
+#include "arena.h"
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <iostream>
+
+#define MAX_LEVEL 8
+
+enum SKNodeType : uint8_t
+{
+    HEAD = 1,
+    NORMAL,
+    NIL
+};
+
+// 结点的一版 value：写入序号、类型与字节连续存放，更新时整体替换，并发的读者总是看到完整的一版
+// 被替换的版本仍在内存池中，经由 prev 按序号从新到旧串起，读者据此跳过尚未公开的写入
+struct SKValue
+{
+    uint64_t seq; // 写入序号，与同一跳表中的范围删除比较新旧
+    std::atomic<SKValue *> prev; // 序号更小的上一版，没有时为 nullptr
+    uint32_t len;
+    ValueType type; // 删除标记的 len 为 0
+
+    const char *Data() const {return reinterpret_cast<const char *>(this + 1);}
+    size_t Size() const {return sizeof(SKValue) + len;}
+};
+
+// 跳表结点，连同指针塔与第一版 value 一起在跳表的内存池中分配：forwards 的实际长度为结点的高度，value 紧随其后
+// 大多数结点只有一两层，不再为每个结点分配 MAX_LEVEL 个指针与单独的字符串
+// 指针与 value 都以原子操作读写：写者用 CAS 链入结点、替换 value，读者不加锁
+struct SKNode
+{
+    uint64_t key;
+    std::atomic<SKValue *> value;
+    SKNodeType type;
+    uint8_t height;
+    std::atomic<SKNode *> forwards[1];
+
+    SKNode *Next(int level) const {return forwards[level].load(std::memory_order_acquire);}
+    const SKValue *Value() const {return value.load(std::memory_order_acquire);}
+};
+
+// 并发的跳表：多个写者可以同时插入不同的键，Search、Seek 与游标不加锁
+// 每个写者由 BeginWrite 分配一段连续的写入序号，同一个键的并发更新按序号而不是到达跳表的先后决定新旧
+// 写者插入全部记录后 Publish；序号不超过 visible 的写入都已公开，读者只看到这些写入，一个写者的记录要么全部可见要么全部不可见
+// 范围删除推迟到所在的写者公开时按序号顺序应用，只在有范围删除时读者才需要 mutex
+class SkipList
+{
+private:
+    // 已经分配序号、尚未公开的一个写者
+    struct InflightWrite {
+        uint64_t last; // 最后一个序号
+        bool done; // 已经 Publish，等待序号更小的写者
+        std::vector<RangeTombstone> ranges; // 公开时才应用的范围删除
+    };
+
+    std::atomic<int> dataLength;  // 当前跳表转化为 sst 文件的基础长度（Header，不含随键数增长的 Bloom Filter）
+    std::atomic<int> count; // 键值对的个数
+    std::atomic<int> wasted; // 被更新替换或并发插入落败而废弃在内存池中的字节数
+    std::atomic<uint64_t> last_seq; // 最近分配的写入序号（包括范围删除）
+    std::atomic<uint64_t> visible; // 序号不超过它的写入都已公开，等于 last_seq 时没有未公开的写入
+    std::atomic<int> writing; // 已经 BeginWrite、尚未 EndWrite 的写者个数
+    std::atomic<int> pending; // 这些写者中键值对的个数
+    std::atomic<int> pending_bytes; // 这些写入的长度
+    Arena arena; // 全部结点与 value，跳表析构时整体释放
+    mutable std::mutex mutex; // 保护 inflight、range_tombstones 以及 visible 的推进
+    std::map<uint64_t, InflightWrite> inflight; // 以第一个序号为键
+    std::atomic<bool> has_ranges;
+    RangeTombstoneList range_tombstones;
+
+    static int randomLevel();
+    SKNode *NewNode(uint64_t key, const std::string &value, SKNodeType type, ValueType value_type, uint64_t seq, int height);
+    SKValue *NewValue(const std::string &value, ValueType value_type, uint64_t seq);
+    SKNode *FindGreaterOrEqual(uint64_t key, SKNode **prev) const;
+    void Update(SKNode *node, const std::string &value, ValueType value_type, uint64_t seq);
+    uint64_t Snapshot(uint64_t key, uint64_t &tombstone) const;
+    void ApplyRange(const RangeTombstone &t);
+
+public:
+    SKNode *head;
+    SKNode *NIL;
+    SkipList();
+    SkipList(const SkipList &) = delete;
+    SkipList &operator=(const SkipList &) = delete;
+
+    void Insert(uint64_t key, const std::string &value, ValueType value_type = TYPE_VALUE);
+    void Insert(uint64_t key, const std::string &value, ValueType value_type, uint64_t seq);
+    bool Search(uint64_t key, std::string &str_ptr, ValueType &value_type) const;
+    SKNode *Seek(uint64_t key) const; // 返回第一个键不小于 key 的结点
+    void DeleteRange(uint64_t begin, uint64_t end);
+    void DeleteRange(uint64_t begin, uint64_t end, uint64_t seq);
+    uint64_t RangeFragments(std::vector<RangeTombstone> &out) const;
+    bool Covered(const SKNode *node, const SKValue *value) const;
+    static const SKValue *Visible(const SKNode *node, uint64_t snapshot);
+    void Display();
+
+    // 写者登记 records 条记录（其中 entries 个键值对，共 bytes 字节）并分配连续的序号，返回第一个；
+    // 插入全部记录后 Publish，等到自己公开才返回；使行缓存失效等收尾工作完成后 EndWrite。登记的写入计入长度与个数，落盘之前等待它们全部完成
+    uint64_t BeginWrite(int records, int entries, int bytes);
+    void Publish(uint64_t seq);
+    void EndWrite(int entries, int bytes) {pending -= entries; pending_bytes -= bytes; writing -- ;}
+    void WaitForWriters() const;
+
+    bool Empty() const {return head->Next(0) == NIL && writing == 0 && !has_ranges;}
+    int GetCurrentDataLength() const {return dataLength + pending_bytes;}
+    int GetCount() const {return count + pending;}
+    int GetWastedBytes() const {return wasted;}
+    uint64_t MemoryUsage() const {return arena.MemoryUsage();}
+};
+
+// 跳表底层链表上的游标，跳表中的数据总是比所有 SSTable 更新
+// 持有跳表的引用计数，后台线程落盘后释放跳表时游标仍然有效
+// 定位到结点时取下它在创建游标时已经公开的最新版本，跳过此后才写入的结点，此后并发的写入不会让游标看到半个写者
+class SkipListIterator : public InternalIterator {
+private:
+    std::shared_ptr<SkipList> list;
+    SKNode *node;
+    const SKValue *current;
+    uint64_t stamp; // 正在写入的跳表比等待落盘的跳表更新
+    uint64_t snapshot; // 只看序号不超过它的版本
+    mutable const SKValue *loaded; // 当前 val 对应的版本
+    mutable std::string val;
+
+    void Load();
+
+public:
+    // 函数参数 snapshot: 与复制范围删除标记时 RangeFragments 的返回值相同，二者才一致
+    SkipListIterator(std::shared_ptr<SkipList> list, uint64_t stamp, uint64_t snapshot)
+        : list(std::move(list)), node(this->list->head->Next(0)), current(nullptr), stamp(stamp), snapshot(snapshot), loaded(nullptr) {Load();}
+
+    bool Valid() const override {return node->type != SKNodeType::NIL;}
+    void Seek(uint64_t target) override {node = list->Seek(target); Load();}
+    void Next() override {node = node->Next(0); Load();}
+    uint64_t key() const override {return node->key;}
+    const std::string &value() const override;
+    ValueType type() const override {return current->type;}
+    uint64_t time() const override {return stamp;}
+    int level() const override {return -1;}
+    uint64_t seq() const override {return current->seq;}
+};
@@ -0,0 +1,740 @@
+#include "sstable.h"
+#include "compress.h"
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+// 返回值为数组下标，SST_NOT_FOUND 表示没有找到
+uint64_t binarySearch(const uint64_t *a, uint64_t n, uint64_t target)
+{
+    if (n == 0)
+        return SST_NOT_FOUND;
+    uint64_t low = 0, high = n-1, middle;
+    while(low <= high)
+    {
+        middle = low + (high - low) / 2;
+        if(target == a[middle])
+            return middle;
+        else if(target > a[middle])
+            low = middle + 1;
+        else if(target < a[middle]) {
+            if (middle == 0)
+                return SST_NOT_FOUND;
+            else
+                high = middle - 1;
+        }
+    }
+    return SST_NOT_FOUND;
+}
+
+// 函数返回值 bool: 文件完整时返回 true；进程在写文件的过程中被杀死会留下残缺的文件，返回 false
+// 函数功能：从磁盘文件中读入 Header、Bloom Filter 以及索引区，Header 读取一次，Bloom Filter 与索引区连续存放，再读取一次
+bool sst_buf::Read()
+{
+    std::shared_ptr<TableFile> file = Open();
+    if (!file)
+        return false;
+
+    // 旧格式的文件也不短于新格式的 Header，一次读入
+    char header[SST_HEADER_SIZE];
+    if (!file->Read(0, SST_HEADER_SIZE, header))
+        return false;
+    // 由 MANIFEST 恢复的文件已经有这四项，并且正被不加锁的 get 与迭代器读取，与文件头相同时不再写入
+    uint64_t fields[4];
+    memcpy(fields, header, sizeof(fields));
+    if (time != fields[0]) time = fields[0];
+    if (num != fields[1]) num = fields[1];
+    if (min != fields[2]) min = fields[2];
+    if (max != fields[3]) max = fields[3];
+
+    uint64_t magic;
+    memcpy(&magic, header + 32, sizeof(uint64_t));
+    if ((magic & SST_MAGIC_MASK) != SST_MAGIC_TAG) {
+        format = SST_FORMAT_LEGACY;
+        filter_bytes = 10240;
+        filter_probes = 4;
+    } else {
+        format = (uint32_t) (magic >> 56) - '0';
+        if (format != SST_FORMAT_VERSION)
+            return false; // 更新版本写出的文件
+        memcpy(&filter_bytes, header + 40, sizeof(uint32_t));
+        memcpy(&filter_probes, header + 44, sizeof(uint32_t));
+        memcpy(&num_blocks, header + 48, sizeof(uint32_t));
+        memcpy(&block_key_bytes, header + 52, sizeof(uint32_t));
+        memcpy(&flags, header + 56, sizeof(uint32_t));
+        if (flags & ~SST_KNOWN_FLAGS)
+            return false;
+        if (filter_probes < 1 || filter_probes > BLOOM_BLOCK_PROBES)
+            return false; // 分块布局每块只有 8 个字，探测次数不能更多
+        if ((flags & ~SST_FLAG_DATA_BLOCKS) && !Blocked())
+            return false; // 其余标志位只用于分块的数据区
+    }
+
+    uint64_t length = file->Size();
+    if (length < MetaSize())
+        return false;
+
+    // 载入 Bloom Filter 与索引区
+    std::string scratch;
+    const char *meta = file->Read(HeaderSize(), filter_bytes + IndexSize(), scratch);
+    if (meta == nullptr)
+        return false;
+    filter = BloomFilter::Allocate(filter_bytes);
+    memcpy(filter, meta, filter_bytes);
+    const char *index = meta + filter_bytes;
+
+    uint64_t end; // 索引区中最大的地址，文件不能比它短
+    if (flags & SST_FLAG_ELIAS_FANO) {
+        block_key_ef = new EliasFano;
+        block_offset = new uint32_t [num_blocks + 1];
+        if (!block_key_ef->Decode(index, block_key_bytes, num_blocks)) {
+            Free();
+            return false;
+        }
+        memcpy(block_offset, &index[block_key_bytes], 4 * (num_blocks + 1));
+        end = block_offset[num_blocks];
+    } else if (Blocked()) {
+        block_key = new uint64_t [num_blocks];
+        block_offset = new uint32_t [num_blocks + 1];
+        for (uint32_t i=0; i<num_blocks; ++i) {
+            memcpy(&block_key[i], &index[12 * i], sizeof(uint64_t));
+            memcpy(&block_offset[i], &index[12 * i + 8], sizeof(uint32_t));
+        }
+        memcpy(&block_offset[num_blocks], &index[12 * num_blocks], sizeof(uint32_t));
+        end = block_offset[num_blocks];
+    } else {
+        key = new uint64_t [num];
+        offset = new uint32_t [num]; // 动态分配内存
+        for (uint64_t i=0; i<num; ++i) {
+            memcpy(&key[i], &index[12 * i], sizeof(uint64_t));
+            memcpy(&offset[i], &index[12 * i + 8], sizeof(uint32_t));
+        }
+        end = num > 0 ? offset[num - 1] : 0;
+    }
+
+    // 索引完整但数据区被截断的文件同样不可用
+    if (end > length) {
+        Free();
+        return false;
+    }
+    data_end = Blocked() ? end : length;
+
+    // 数据区之后的范围删除标记，恰好占满文件的剩余部分
+    if (flags & SST_FLAG_RANGE_DELETIONS) {
+        uint32_t count;
+        std::string ranges;
+        if (length - data_end < 4 || !file->Read(data_end, 4, (char*)&count) || length - data_end - 4 != 16ULL * count) {
+            Free();
+            return false;
+        }
+        const char *src = file->Read(data_end + 4, 16ULL * count, ranges);
+        if (count > 0 && src == nullptr) {
+            Free();
+            return false;
+        }
+        range_tombstones.reserve(count);
+        for (uint32_t i=0; i<count; ++i) {
+            uint64_t begin, end;
+            memcpy(&begin, src + 16 * i, sizeof(uint64_t));
+            memcpy(&end, src + 16 * i + 8, sizeof(uint64_t));
+            range_tombstones.emplace_back(begin, end, 0);
+        }
+    }
+
+    loaded = true;
+    return true;
+}
+
+// 函数功能：保证 Bloom Filter 与索引区已经读入，可以被多个线程同时调用
+// MANIFEST 中记录的文件都已经持久化，读取失败说明文件在外部被损坏，此时按空表处理
+void sst_buf::Load()
+{
+    std::call_once(load_flag, [this]() {
+        if (!loaded && !Read()) {
+            num = 0;
+            num_blocks = 0;
+        }
+    });
+}
+
+// 函数功能：释放 Bloom Filter 与索引区
+void sst_buf::Free()
+{
+    BloomFilter::Release(filter);
+    delete [] key;
+    delete [] offset;
+    delete [] block_key;
+    delete [] block_offset;
+    delete block_key_ef;
+    filter = nullptr;
+    key = nullptr;
+    offset = nullptr;
+    block_key = nullptr;
+    block_offset = nullptr;
+    block_key_ef = nullptr;
+    std::vector<RangeTombstone>().swap(range_tombstones);
+}
+
+// 函数返回值 shared_ptr<TableFile>: 打开的文件，经由 cache 时命中不需要任何系统调用；文件不存在时为空
+std::shared_ptr<TableFile> sst_buf::Open() const
+{
+    if (cache != nullptr)
+        return cache->Open(path);
+    return TableFile::Open(path, false);
+}
+
+// 函数参数 file: 已经打开的文件，为空时在需要读取时打开
+// 函数参数 scratch: 不放入块缓存时存放读入的数据块
+// 函数参数 handle: 数据块来自块缓存时为固定的句柄，调用者用完后 Release；否则为 nullptr
+// 函数参数 fill_cache: 未命中时是否将读入的数据块放入块缓存
+// 函数返回值 const DataBlock*: 第 b 个数据块，读取失败时为 nullptr
+// 函数功能：先查找块缓存，命中时不需要打开文件，也不需要复制数据块
+const DataBlock *sst_buf::ReadBlock(uint32_t b, std::shared_ptr<TableFile> &file, DataBlock &scratch, BlockCache::Handle *&handle, bool fill_cache) const
+{
+    handle = nullptr;
+    if (block_cache != nullptr) {
+        handle = block_cache->Lookup(block_cache_id, block_offset[b]);
+        if (handle != nullptr)
+            return handle->block;
+    }
+
+    if (!file)
+        file = Open();
+    if (!file)
+        return nullptr;
+    DataBlock *block = block_cache != nullptr && fill_cache ? new DataBlock : &scratch;
+    if (!block->Read(*file, block_offset[b], block_offset[b + 1] - block_offset[b], flags)) {
+        if (block != &scratch)
+            delete block;
+        return nullptr;
+    }
+    if (block != &scratch)
+        handle = block_cache->Insert(block_cache_id, block_offset[b], block, block->Memory());
+    return block;
+}
+
+// 函数参数 hash: BloomFilter::Hash 得到的哈希值，同一次查找中对所有文件共用
+bool sst_buf::MayContain(const uint64_t hash[2]) const
+{
+    if (format == SST_FORMAT_LEGACY)
+        return BloomFilter::LegacyMayContain(filter, hash);
+    return BloomFilter::BlockedMayContain(filter, filter_bytes, filter_probes, hash);
+}
+
+// 函数返回值 uint32_t: 第一个最大键不小于 target 的数据块，不存在时返回 num_blocks
+uint32_t sst_buf::FindBlock(uint64_t target) const
+{
+    if (block_key_ef != nullptr)
+        return block_key_ef->LowerBound(target);
+    return std::lower_bound(block_key, block_key + num_blocks, target) - block_key;
+}
+
+// 函数返回值 uint64_t: 索引区与范围删除标记读入内存后占用的字节数
+uint64_t sst_buf::IndexMemory() const
+{
+    uint64_t ranges = sizeof(RangeTombstone) * range_tombstones.size();
+    if (block_key_ef != nullptr)
+        return block_key_ef->MemoryBytes() + 4 * (num_blocks + 1) + ranges;
+    return IndexSize() + ranges;
+}
+
+// 函数参数 target: 需要查找的键；函数参数 val: 找到时存放对应的 value，为 nullptr 时只确定类型；函数参数 type: 找到时存放键值对的类型
+// 函数返回值 bool: 文件中是否存在该键（包括删除标记）
+// 函数功能：分块格式先由稀疏索引确定唯一可能的数据块，读入后在块内二分查找；其余格式直接在索引区二分查找
+// 确定位置之后才打开文件，只读取一次：映射的文件没有系统调用，否则为一次 pread；数据块在块缓存中时不访问文件
+// value 直接从固定的缓存数据块复制到 val 中；逐键索引的格式只有长度与旧删除标记相同时才需要读取 value 来确定类型
+bool sst_buf::Get(uint64_t target, std::string *val, ValueType &type) const
+{
+    if (Blocked()) {
+        uint32_t b = FindBlock(target);
+        if (b == num_blocks)
+            return false;
+
+        std::shared_ptr<TableFile> file;
+        DataBlock scratch;
+        BlockCache::Handle *handle;
+        const DataBlock *block = ReadBlock(b, file, scratch, handle, true);
+        if (block == nullptr)
+            return false;
+        uint32_t i = block->Seek(target);
+        bool found = i < block->Count() && block->Key(i) == target;
+        if (found) {
+            if (val != nullptr)
+                block->Value(i, *val);
+            type = block->Type(i);
+        }
+        if (handle != nullptr)
+            block_cache->Release(handle);
+        return found;
+    }
+
+    uint64_t index = binarySearch(key, num, target);
+    if (index == SST_NOT_FOUND)
+        return false;
+
+    uint32_t destOffset = offset[index];
+    uint32_t destLength;
+    if (index == num - 1)
+        destLength = data_end - destOffset;
+    else
+        destLength = offset[index + 1] - destOffset;
+
+    if (val == nullptr && destLength != strlen(LEGACY_DELETED_VALUE)) {
+        type = TYPE_VALUE;
+        return true;
+    }
+
+    std::string scratch;
+    std::string &dest = val != nullptr ? *val : scratch;
+    std::shared_ptr<TableFile> file = Open();
+    dest.resize(destLength);
+    if (!file || !file->Read(destOffset, destLength, &dest[0]))
+        return false;
+    type = dest == LEGACY_DELETED_VALUE ? TYPE_DELETION : TYPE_VALUE;
+    return true;
+}
+
+// 函数参数 flags: 所在文件的 SST_FLAG_*，决定数据块是否以类型字节开头、结束位置是否带删除标记位
+// 函数功能：读入 [offset, offset + length) 处的数据块，必要时解压，并检查块内记录的键值对个数与长度是否相符
+// 映射的文件直接从映射区解压或复制，其余情况先读入临时缓冲区
+bool DataBlock::Read(const TableFile &file, uint32_t offset, uint32_t length, uint32_t flags)
+{
+    count = 0;
+    value_types = flags & SST_FLAG_VALUE_TYPE;
+    bool typed = flags & SST_FLAG_BLOCK_TYPE;
+    std::string scratch;
+    const char *src = length > 0 ? file.Read(offset, length, scratch) : nullptr;
+    if (src == nullptr)
+        return false;
+
+    if (typed) {
+        auto type = (CompressionType) (uint8_t) src[0];
+        src ++ ;
+        length -- ;
+        if (type != NO_COMPRESSION) {
+            uint32_t raw_len;
+            if (length < 4)
+                return false;
+            memcpy(&raw_len, src, sizeof(uint32_t));
+            data.resize(raw_len);
+            if (!Compressor::Decompress(type, src + 4, length - 4, &data[0], raw_len))
+                return false;
+            length = raw_len;
+            src = nullptr;
+        }
+    }
+    if (src != nullptr)
+        data.assign(src, length);
+    if (length < 4)
+        return false;
+
+    uint32_t n;
+    memcpy(&n, &data[0], sizeof(uint32_t));
+    if (4 + 12ULL * n > length)
+        return false;
+    count = n;
+    return true;
+}
+
+uint64_t DataBlock::Key(uint32_t i) const
+{
+    uint64_t key;
+    memcpy(&key, &data[4 + 8ULL * i], sizeof(uint64_t));
+    return key;
+}
+
+// 二分查找第一个不小于 target 的键，不存在时返回 Count()
+uint32_t DataBlock::Seek(uint64_t target) const
+{
+    uint32_t low = 0, high = count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (Key(middle) < target)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+// 第 i 个 value 在 value 区中的结束位置，不含删除标记位
+uint32_t DataBlock::End(uint32_t i) const
+{
+    uint32_t end;
+    memcpy(&end, &data[4 + 8ULL * count + 4ULL * i], sizeof(uint32_t));
+    return value_types ? end & ~SST_DELETION_BIT : end;
+}
+
+void DataBlock::Value(uint32_t i, std::string &val) const
+{
+    uint32_t begin = i > 0 ? End(i - 1) : 0;
+    val.assign(data, 4 + 12ULL * count + begin, End(i) - begin);
+}
+
+// 旧格式的数据块中删除标记是 value "~DELETED~"
+ValueType DataBlock::Type(uint32_t i) const
+{
+    if (!value_types) {
+        uint32_t begin = i > 0 ? End(i - 1) : 0;
+        return data.compare(4 + 12ULL * count + begin, End(i) - begin, LEGACY_DELETED_VALUE) == 0 ? TYPE_DELETION : TYPE_VALUE;
+    }
+    uint32_t end;
+    memcpy(&end, &data[4 + 8ULL * count + 4ULL * i], sizeof(uint32_t));
+    return end & SST_DELETION_BIT ? TYPE_DELETION : TYPE_VALUE;
+}
+
+SSTableIterator::SSTableIterator(sst_buf *table, bool fill_cache): table(table), index(0), loaded(-1), block_index(0),
+    fill_cache(fill_cache), block(&scratch), handle(nullptr)
+{
+    table->Load();
+    file = table->Open();
+    if (!file) {
+        index = table->num;
+        block_index = table->num_blocks;
+        return;
+    }
+
+    if (table->Blocked())
+        LoadBlock(0);
+}
+
+SSTableIterator::~SSTableIterator()
+{
+    ReleaseBlock();
+}
+
+// 函数功能：读入第 b 个数据块并指向其中第一个键值对，读取失败时迭代结束
+void SSTableIterator::LoadBlock(uint32_t b)
+{
+    ReleaseBlock();
+    block_index = b;
+    index = 0;
+    loaded = -1;
+    if (block_index >= table->num_blocks)
+        return;
+    block = table->ReadBlock(b, file, scratch, handle, fill_cache);
+    if (block == nullptr || block->Count() == 0) {
+        ReleaseBlock();
+        block_index = table->num_blocks;
+    }
+}
+
+// 函数功能：释放当前固定的缓存数据块
+void SSTableIterator::ReleaseBlock()
+{
+    if (handle != nullptr)
+        table->block_cache->Release(handle);
+    handle = nullptr;
+    block = &scratch;
+}
+
+// 二分查找第一个不小于 target 的键
+void SSTableIterator::Seek(uint64_t target)
+{
+    if (!file)
+        return;
+    if (!table->Blocked()) {
+        index = std::lower_bound(table->key, table->key + table->num, target) - table->key;
+        return;
+    }
+
+    // 索引区记录的是每块的最大键，第一个最大键不小于 target 的块中就有要找的键
+    uint32_t b = table->FindBlock(target);
+    if (b != block_index)
+        LoadBlock(b);
+    if (Valid()) {
+        index = block->Seek(target);
+        loaded = -1;
+    }
+}
+
+// 分块格式读完一个数据块后接着读入下一块
+void SSTableIterator::Next()
+{
+    index ++ ;
+    if (table->Blocked() && index == block->Count())
+        LoadBlock(block_index + 1);
+}
+
+const std::string &SSTableIterator::value() const
+{
+    if (loaded == index)
+        return val;
+
+    if (table->Blocked()) {
+        block->Value(index, val);
+        loaded = index;
+        return val;
+    }
+
+    uint32_t destOffset = table->offset[index];
+    uint32_t destLength;
+    if (index == table->num - 1)
+        destLength = table->data_end - destOffset;
+    else
+        destLength = table->offset[index + 1] - destOffset;
+
+    val.resize(destLength);
+    if (!file->Read(destOffset, destLength, &val[0]))
+        val.clear();
+    loaded = index;
+    return val;
+}
+
+// 每键索引的格式没有类型，删除标记是 value "~DELETED~"
+ValueType SSTableIterator::type() const
+{
+    if (table->Blocked())
+        return block->Type(index);
+    return value() == LEGACY_DELETED_VALUE ? TYPE_DELETION : TYPE_VALUE;
+}
+
+SSTableWriter::SSTableWriter(uint64_t timeStamp, const Options &options): time(timeStamp), bits_per_key(options.bloom_bits_per_key),
+    block_size(options.block_size), elias_fano(options.elias_fano_index), compression(options.compression),
+    compression_ratio(options.compression_ratio), written(0)
+{
+    Reset();
+}
+
+// 函数功能：清空状态，准备构造下一个文件
+void SSTableWriter::Reset()
+{
+    keys.clear();
+    lens.clear();
+    types.clear();
+    block_start.clear();
+    ranges.clear();
+    data.clear();
+    bytes = block_size > 0 ? SST_HEADER_SIZE + 4 : SST_HEADER_SIZE; // 分块格式的索引区末尾记录数据区的结束地址
+    block_bytes = 0;
+}
+
+// Bloom Filter 的大小随键值对数量增长，需要计入文件的总字节数；新开一个数据块还需要块头与一个索引项
+// Elias-Fano 编码的索引区按未编码的大小估计，只有块数极少时才会略大于估计值；数据块按压缩前的大小计算
+bool SSTableWriter::Fits(const std::string &val, ValueType type) const
+{
+    uint64_t block = NewBlock() ? BlockOverhead() : 0;
+    return bytes + block + 12 + StoredLength(val, type) + BloomFilter::BlockedBytes(keys.size() + 1, bits_per_key) <= SST_MAX_SIZE;
+}
+
+// 新的一段范围删除标记占用 16 字节，第一段还需要记录段数
+bool SSTableWriter::FitsRange() const
+{
+    uint64_t count = ranges.empty() ? 4 : 0;
+    return bytes + count + 16 + BloomFilter::BlockedBytes(keys.size(), bits_per_key) <= SST_MAX_SIZE;
+}
+
+// 删除标记在分块格式中不占用 value 字节，在每键索引的格式中写为 "~DELETED~"
+uint64_t SSTableWriter::StoredLength(const std::string &val, ValueType type) const
+{
+    if (type == TYPE_DELETION)
+        return block_size > 0 ? 0 : strlen(LEGACY_DELETED_VALUE);
+    return val.length();
+}
+
+// 分块格式中，最后一个数据块达到 block_size 之后的键值对放入新的数据块
+void SSTableWriter::Add(uint64_t key, const std::string &val, ValueType type)
+{
+    if (NewBlock()) {
+        block_start.push_back(keys.size());
+        bytes += BlockOverhead();
+        block_bytes = 4;
+    }
+    uint64_t len = StoredLength(val, type);
+    keys.push_back(key);
+    lens.push_back((uint32_t) len);
+    types.push_back((uint8_t) type);
+    if (type == TYPE_DELETION)
+        data.append(LEGACY_DELETED_VALUE, len);
+    else
+        data.append(val);
+    bytes += 12 + len;
+    block_bytes += 12 + len;
+}
+
+// 函数功能：添加 [begin, end] 的范围删除标记，起点须大于已有各段的终点，与上一段首尾相接时合并为一段
+void SSTableWriter::AddRange(uint64_t begin, uint64_t end)
+{
+    if (!ranges.empty() && ranges.back().end + 1 == begin) {
+        ranges.back().end = end;
+        return;
+    }
+    bytes += (ranges.empty() ? 4 : 0) + 16;
+    ranges.emplace_back(begin, end, 0);
+}
+
+// 函数参数 blocks: 分块格式的数据区；函数参数 block: 未压缩的数据块
+// 函数功能：压缩后不超过原大小的 compression_ratio 才保存压缩结果，不可压缩的数据块原样保存
+void SSTableWriter::AppendBlock(std::string &blocks, const std::string &block) const
+{
+    if (compression == NO_COMPRESSION) {
+        blocks.append(block);
+        return;
+    }
+
+    std::string compressed;
+    if (Compressor::Compress(compression, block.c_str(), block.length(), compressed)
+        && compressed.length() + 4 <= block.length() * compression_ratio) {
+        uint32_t raw_len = block.length();
+        blocks.push_back((char) compression);
+        blocks.append((char*)&raw_len, sizeof(uint32_t));
+        blocks.append(compressed);
+    } else {
+        blocks.push_back((char) NO_COMPRESSION);
+        blocks.append(block);
+    }
+}
+
+// 函数参数 path: 需要写入的磁盘文件路径
+// 函数返回值 sst_buf* : 新文件对应的缓冲区结构体（尚未链入链表），写入失败（如磁盘已满）时删除残缺的文件并返回 nullptr
+sst_buf *SSTableWriter::Finish(const std::string &path)
+{
+    auto *add = new sst_buf;
+    add->loaded = true;
+    add->time = time;
+    add->num = keys.size();
+    add->min = UINT64_MAX;
+    add->max = 0;
+    if (!keys.empty()) {
+        add->min = keys.front();
+        add->max = keys.back();
+    }
+    if (!ranges.empty()) {
+        add->min = std::min(add->min, ranges.front().begin);
+        add->max = std::max(add->max, ranges.back().end);
+    }
+    add->path = path;
+    add->format = SST_FORMAT_VERSION;
+    if (block_size > 0) {
+        add->flags |= SST_FLAG_DATA_BLOCKS;
+        add->flags |= elias_fano && !keys.empty() ? SST_FLAG_ELIAS_FANO : 0; // 只有范围删除标记的文件没有数据块
+        add->flags |= compression != NO_COMPRESSION ? SST_FLAG_BLOCK_TYPE : 0;
+        add->flags |= SST_FLAG_VALUE_TYPE;
+        add->flags |= !ranges.empty() ? SST_FLAG_RANGE_DELETIONS : 0;
+        add->range_tombstones = ranges;
+    }
+    add->filter_bytes = BloomFilter::BlockedBytes(add->num, bits_per_key);
+    add->filter_probes = BloomFilter::BlockedProbes(bits_per_key);
+    add->filter = BloomFilter::Allocate(add->filter_bytes);
+
+    // 每个键计算一次哈希，设置 Bloom Filter
+    for (uint64_t i=0; i<add->num; ++i) {
+        uint64_t hash[2];
+        BloomFilter::Hash(keys[i], hash);
+        BloomFilter::BlockedAdd(add->filter, add->filter_bytes, add->filter_probes, hash);
+    }
+
+    std::string blocks; // 分块格式的数据区
+    std::string ef; // 编码后的各块最大键
+    if (add->Blocked()) {
+        add->num_blocks = block_start.size();
+        add->block_key = new uint64_t [add->num_blocks];
+        add->block_offset = new uint32_t [add->num_blocks + 1];
+        block_start.push_back(add->num);
+        for (uint32_t b=0; b<add->num_blocks; ++b)
+            add->block_key[b] = keys[block_start[b + 1] - 1];
+
+        // 编码之后索引区的大小才能确定，进而确定数据区的起始地址
+        if (add->flags & SST_FLAG_ELIAS_FANO) {
+            add->block_key_ef = new EliasFano;
+            add->block_key_ef->Build(add->block_key, add->num_blocks);
+            add->block_key_ef->Encode(ef);
+            add->block_key_bytes = ef.length();
+        }
+
+        uint64_t base = add->MetaSize(); // 数据区的起始地址
+        const char *value = data.c_str();
+        for (uint32_t b=0; b<add->num_blocks; ++b) {
+            uint64_t first = block_start[b], last = block_start[b + 1];
+            uint32_t count = last - first;
+            add->block_offset[b] = base + blocks.length();
+
+            std::string block;
+            block.append((char*)&count, sizeof(uint32_t));
+            block.append((char*)&keys[first], 8 * count);
+            uint32_t end = 0;
+            for (uint64_t i=first; i<last; ++i) {
+                end += lens[i];
+                uint32_t tagged = types[i] == TYPE_DELETION ? end | SST_DELETION_BIT : end;
+                block.append((char*)&tagged, sizeof(uint32_t));
+            }
+            block.append(value, end);
+            value += end;
+            AppendBlock(blocks, block);
+        }
+        add->block_offset[add->num_blocks] = base + blocks.length();
+        add->data_end = add->block_offset[add->num_blocks];
+
+        if (!ranges.empty()) {
+            uint32_t count = ranges.size();
+            blocks.append((char*)&count, sizeof(uint32_t));
+            for (auto &range : ranges) {
+                blocks.append((char*)&range.begin, sizeof(uint64_t));
+                blocks.append((char*)&range.end, sizeof(uint64_t));
+            }
+        }
+    } else {
+        add->key = new uint64_t [add->num];
+        add->offset = new uint32_t [add->num];
+        uint32_t offset = add->MetaSize(); // 数据区的起始地址
+        for (uint64_t i=0; i<add->num; ++i) {
+            add->key[i] = keys[i];
+            add->offset[i] = offset;
+            offset += lens[i];
+        }
+        add->data_end = offset;
+    }
+
+    // Header、Bloom Filter 与索引区先在内存中拼好，再与数据区一起写出
+    uint64_t magic = SST_MAGIC_TAG | (uint64_t) ('0' + add->format) << 56;
+    std::string meta;
+    meta.append((char*)&add->time, sizeof(uint64_t));
+    meta.append((char*)&add->num, sizeof(uint64_t));
+    meta.append((char*)&add->min, sizeof(uint64_t));
+    meta.append((char*)&add->max, sizeof(uint64_t));
+    meta.append((char*)&magic, sizeof(uint64_t));
+    meta.append((char*)&add->filter_bytes, sizeof(uint32_t));
+    meta.append((char*)&add->filter_probes, sizeof(uint32_t));
+    meta.append((char*)&add->num_blocks, sizeof(uint32_t));
+    meta.append((char*)&add->block_key_bytes, sizeof(uint32_t));
+    meta.append((char*)&add->flags, sizeof(uint32_t));
+    meta.append((char*)add->filter, add->filter_bytes);
+    if (add->flags & SST_FLAG_ELIAS_FANO) {
+        meta.append(ef);
+        meta.append((char*)add->block_offset, 4 * (add->num_blocks + 1));
+    } else if (add->Blocked()) {
+        for (uint32_t b=0; b<add->num_blocks; ++b) {
+            meta.append((char*)&add->block_key[b], sizeof(uint64_t));
+            meta.append((char*)&add->block_offset[b], sizeof(uint32_t));
+        }
+        meta.append((char*)&add->block_offset[add->num_blocks], sizeof(uint32_t));
+    } else {
+        for (uint64_t i=0; i<add->num; ++i) {
+            meta.append((char*)&add->key[i], sizeof(uint64_t));
+            meta.append((char*)&add->offset[i], sizeof(uint32_t));
+        }
+    }
+
+    // 内存中只保留编码后的最大键
+    if (add->flags & SST_FLAG_ELIAS_FANO) {
+        delete [] add->block_key;
+        add->block_key = nullptr;
+    }
+
+    std::ofstream out(path, std::ios::out|std::ios::trunc|std::ios::binary);
+    out.write(meta.c_str(), (long) meta.length());
+    if (add->Blocked())
+        out.write(blocks.c_str(), (long) blocks.length());
+    else
+        out.write(data.c_str(), (long) data.length());
+    bool good = out.good(); // 写入失败时置 badbit
+    out.close(); // 缓冲区中剩余的内容在关闭时才写入，失败时置 failbit
+    Reset();
+    if (!good || !out.good()) {
+        std::remove(path.c_str());
+        delete add;
+        return nullptr;
+    }
+    written = meta.length() + (add->Blocked() ? blocks.length() : data.length());
+    return add;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include "iterator.h"
+#include "bloom.h"
+#include "elias_fano.h"
+#include "options.h"
+#include "table_cache.h"
+#include "block_cache.h"
+
+#define SST_MAX_SIZE (2 * 1024 * 1024) // 单个 sst 文件的最大字节数
+#define SST_HEADER_SIZE 60 // Header(32) + 魔数(8) + Bloom Filter 字节数(4) + 哈希次数(4) + 数据块个数(4) + 编码后各块最大键的字节数(4) + 标志位(4)
+#define SST_MAGIC_TAG 0x0056545353564b4cULL // 魔数的低 7 字节 "LKVSSTV"，最高字节为格式版本号的 ASCII 字符
+#define SST_MAGIC_MASK 0x00ffffffffffffffULL
+#define SST_FORMAT_LEGACY 1 // 没有魔数、固定 10240 字节 Bloom Filter 的旧格式
+#define SST_FORMAT_VERSION 2 // "LKVSSTV2"，分块 Bloom Filter，Header 中的标志位决定数据区与索引区的编码
+#define SST_FLAG_DATA_BLOCKS 1 // 数据区划分为数据块，索引区每块一项；没有该标志的文件每个键都有索引项
+#define SST_FLAG_ELIAS_FANO 2 // 索引区中各块的最大键用 Elias-Fano 编码
+#define SST_FLAG_BLOCK_TYPE 4 // 每个数据块以类型字节开头，标明压缩方式，压缩的块随后是解压后的字节数(4)
+#define SST_FLAG_VALUE_TYPE 8 // 数据块中 value 结束位置的最高位标记删除，删除标记不占用 value 字节；没有该标志的文件以 "~DELETED~" 表示删除
+#define SST_FLAG_RANGE_DELETIONS 16 // 数据区之后是范围删除标记：段数(4) + 各段的起点(8) 与终点(8)，按起点升序且互不重叠
+#define SST_KNOWN_FLAGS (SST_FLAG_DATA_BLOCKS | SST_FLAG_ELIAS_FANO | SST_FLAG_BLOCK_TYPE | SST_FLAG_VALUE_TYPE | SST_FLAG_RANGE_DELETIONS) // 含有其他标志位的文件由更新的版本写出，无法读取
+#define SST_DELETION_BIT 0x80000000U
+#define SST_LEGACY_HEADER_SIZE 32 // 旧格式的 Header 字节数，之后是固定 10240 字节的 Bloom Filter
+
+struct sst_buf {
+    uint64_t time; // SSTable的时间戳
+    uint64_t num; // SSTable键值对的数量
+    uint64_t min; // 键的最小值
+    uint64_t max; // 键的最大值
+
+    // Bloom Filter，大小与哈希次数记录在文件头中
+    uint8_t *filter;
+    uint32_t filter_bytes;
+    uint32_t filter_probes;
+    uint32_t format; // 文件格式版本，SST_FORMAT_*
+    uint32_t flags; // SST_FLAG_*，旧格式为 0
+
+    // 索引区，动态数组大小为键值对数量 num 的两倍（分块格式中为空）
+    uint64_t *key;
+    uint32_t *offset;
+
+    // 分块格式的稀疏索引：每个数据块的最大键与起始地址，block_offset 多出的一项是数据区的结束地址
+    // Elias-Fano 格式中最大键只保存编码后的形式，block_key 为空
+    uint32_t num_blocks;
+    uint64_t *block_key;
+    uint32_t *block_offset;
+    EliasFano *block_key_ef;
+    uint32_t block_key_bytes; // 编码后的字节数
+
+    uint64_t data_end; // 数据区的结束地址：分块格式为索引区的最后一项，其余格式为文件长度，读取 value 时无需再求文件长度
+
+    // 范围删除标记，只删除比本文件更旧的文件中的键值对；min 与 max 包括这些区间
+    std::vector<RangeTombstone> range_tombstones;
+
+    // 在缓冲区的每个结构体中加入磁盘对应文件的路径以及所在的层数 (COMPACTION)
+    std::string path;
+    TableCache *cache; // 为空时每次读取单独打开文件
+    BlockCache *block_cache; // 为空时每次读取数据块都从文件中读入
+    uint64_t block_cache_id; // 在 block_cache 中区分文件的序号，由 BlockCache::NewId 分配
+    int level;
+    bool being_compacted; // 已经被某个 compaction 选为输入
+
+    // 引用计数：每个包含它的 Version 各持有一个引用，compaction 的输入在删除之前另有一个，减为 0 时释放结构体
+    std::atomic<int> refs;
+
+    // 由 MANIFEST 恢复的文件只有元数据，Bloom Filter 与索引区在第一次访问（或后台预读）时才读入
+    bool loaded;
+    std::once_flag load_flag;
+
+    sst_buf() {
+        time = 0;
+        num = 0;
+        min = 0;
+        max = 0;
+        filter = nullptr;
+        filter_bytes = 0;
+        filter_probes = 0;
+        format = SST_FORMAT_VERSION;
+        flags = 0;
+        key = nullptr;
+        offset = nullptr;
+        num_blocks = 0;
+        block_key = nullptr;
+        block_offset = nullptr;
+        block_key_ef = nullptr;
+        block_key_bytes = 0;
+        data_end = 0;
+        cache = nullptr;
+        block_cache = nullptr;
+        block_cache_id = 0;
+        level = 0;
+        being_compacted = false;
+        refs = 0;
+        loaded = false;
+    };
+
+    ~sst_buf() {
+        Free();
+    }
+
+    void Ref() {++refs;}
+    void Unref() {
+        if (--refs == 0)
+            delete this;
+    }
+
+    bool Read();
+    void Load();
+    void Free();
+    std::shared_ptr<TableFile> Open() const;
+    const DataBlock *ReadBlock(uint32_t b, std::shared_ptr<TableFile> &file, DataBlock &scratch, BlockCache::Handle *&handle, bool fill_cache) const;
+    bool MayContain(const uint64_t hash[2]) const;
+    bool Get(uint64_t target, std::string *val, ValueType &type) const;
+    bool RangeDeleted(uint64_t target) const {return FindRangeTombstone(range_tombstones, target) != nullptr;}
+    uint32_t FindBlock(uint64_t target) const;
+    uint64_t IndexMemory() const;
+    bool Blocked() const {return flags & SST_FLAG_DATA_BLOCKS;}
+    uint64_t IndexSize() const { // 索引区的字节数
+        if (flags & SST_FLAG_ELIAS_FANO)
+            return block_key_bytes + 4 * (num_blocks + 1);
+        return Blocked() ? 12 * num_blocks + 4 : 12 * num;
+    }
+    uint64_t HeaderSize() const {return format == SST_FORMAT_LEGACY ? SST_LEGACY_HEADER_SIZE : SST_HEADER_SIZE;}
+    uint64_t MetaSize() const {return HeaderSize() + filter_bytes + IndexSize();} // 数据区的起始地址
+};
+
+// 分块格式中的一个数据块：键值对个数(4) + 各个键(8 * n) + 各个 value 在 value 区中的结束位置(4 * n) + value 区
+// 默认约 4KB，一次读入（必要时解压）后在块内二分查找；超过块大小的 value 单独占据一个块
+// 带 SST_FLAG_VALUE_TYPE 的文件中结束位置的最高位为 SST_DELETION_BIT
+class DataBlock {
+private:
+    std::string data;
+    uint32_t count;
+    bool value_types; // 结束位置是否带删除标记位
+
+    uint32_t End(uint32_t i) const;
+
+public:
+    DataBlock(): count(0), value_types(false) {}
+
+    bool Read(const TableFile &file, uint32_t offset, uint32_t length, uint32_t flags);
+    uint32_t Count() const {return count;}
+    uint64_t Memory() const {return sizeof(DataBlock) + data.capacity();}
+    uint64_t Key(uint32_t i) const;
+    uint32_t Seek(uint64_t target) const;
+    void Value(uint32_t i, std::string &val) const;
+    ValueType Type(uint32_t i) const;
+};
+
+#define SST_NOT_FOUND UINT64_MAX // binarySearch 没有找到目标键
+
+uint64_t binarySearch(const uint64_t *a, uint64_t n, uint64_t target);
+
+// 按键升序读取一个 SSTable 的键值对
+// 索引区直接使用缓冲区中的 key/offset 数组（构造时保证已经读入），数据区只在读取 value 时按需读取，不整体载入内存
+// 分块格式每次读入一个数据块，index 为块内的脚标；迭代期间一直持有打开的文件，文件被淘汰或删除也不受影响
+// 当前数据块来自块缓存时保持固定，切换到下一块或析构时释放；fill_cache 为 false 时（compaction）只查找不插入，避免冲掉热点数据块
+class SSTableIterator : public InternalIterator {
+private:
+    const sst_buf *table;
+    uint64_t index;
+    std::shared_ptr<TableFile> file; // 文件无法打开时为空，迭代器没有任何元素
+    mutable uint64_t loaded; // 当前 val 对应的脚标
+    mutable std::string val;
+    uint32_t block_index; // 当前数据块的序号
+    bool fill_cache;
+    const DataBlock *block; // 指向 scratch 或块缓存中固定的数据块
+    DataBlock scratch;
+    BlockCache::Handle *handle;
+
+    void LoadBlock(uint32_t b);
+    void ReleaseBlock();
+
+public:
+    explicit SSTableIterator(sst_buf *table, bool fill_cache = true);
+    ~SSTableIterator() override;
+
+    bool Valid() const override {return table->Blocked() ? block_index < table->num_blocks : index < table->num;}
+    void Seek(uint64_t target) override;
+    void Next() override;
+    uint64_t key() const override {return table->Blocked() ? block->Key(index) : table->key[index];}
+    const std::string &value() const override;
+    ValueType type() const override;
+    uint64_t time() const override {return table->time;}
+    int level() const override {return table->level;}
+};
+
+// 逐个键值对地构造 sst 文件：Add 累积一个文件的内容，Finish 写入磁盘并返回对应的缓冲区结构体，写入失败时返回 nullptr
+// block_size 为 0 时写出每个键都有索引项的格式（没有标志位，删除标记仍写为 "~DELETED~"，不能含有范围删除标记），否则按 block_size 划分数据块
+class SSTableWriter {
+private:
+    uint64_t time;
+    int bits_per_key;
+    uint32_t block_size;
+    bool elias_fano;
+    CompressionType compression;
+    double compression_ratio;
+    uint64_t bytes; // 当前文件不压缩时的总字节数
+    uint64_t written; // 上一个文件实际写出的字节数
+    uint64_t block_bytes; // 最后一个数据块的字节数
+    std::vector<uint64_t> keys;
+    std::vector<uint32_t> lens;
+    std::vector<uint8_t> types;
+    std::vector<uint64_t> block_start; // 每个数据块第一个键值对的脚标
+    std::vector<RangeTombstone> ranges; // 范围删除标记，按起点升序且互不重叠
+    std::string data; // 所有 value 依次拼接，至多 2MB
+
+    bool NewBlock() const {return block_size > 0 && (keys.empty() || block_bytes >= block_size);}
+    uint64_t BlockOverhead() const {return 4 + 12 + (compression != NO_COMPRESSION ? 5 : 0);} // 块头、索引项与类型字节
+    void Reset();
+    void AppendBlock(std::string &blocks, const std::string &block) const;
+    uint64_t StoredLength(const std::string &val, ValueType type) const;
+
+public:
+    SSTableWriter(uint64_t timeStamp, const Options &options);
+
+    bool Empty() const {return keys.empty() && ranges.empty();}
+    bool Fits(const std::string &val, ValueType type = TYPE_VALUE) const;
+    bool FitsRange() const;
+    uint64_t Written() const {return written;}
+    void Add(uint64_t key, const std::string &val, ValueType type = TYPE_VALUE);
+    void AddRange(uint64_t begin, uint64_t end);
+    sst_buf *Finish(const std::string &path);
+};
@@ -0,0 +1,533 @@
+#include <iostream>
+#include <cstdint>
+#include <string>
+#include <list>
+#include <map>
+#include <random>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <csignal>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "test.h"
+
+class StressTest : public Test {
+private:
+	const uint64_t MODEL_OPS = 100000;
+	const uint64_t MODEL_SPAN = 20000;
+	const int THREADS = 4;
+	const uint64_t SKIPLIST_OPS = 20000;
+	const uint64_t SHARED_KEYS = 64;
+	const uint64_t STORE_OPS = 20000;
+	const uint64_t OWN_KEYS = 500;
+	const uint64_t PINNED_KEYS = 20000;
+	const int CRASH_ROUNDS = 4;
+	const uint64_t BATCH_KEYS = 5;
+
+	std::string dir;
+
+	// Compare the whole key space of kv with the model
+	void check_model(KVStore &kv, const std::map<uint64_t, std::string> &model)
+	{
+		std::list<std::pair<uint64_t, std::string> > list_stu;
+		kv.scan(0, UINT64_MAX, list_stu);
+		EXPECT(model.size(), list_stu.size());
+
+		auto mp = model.begin();
+		auto sp = list_stu.begin();
+		while (mp != model.end() && sp != list_stu.end()) {
+			EXPECT((*mp).first, (*sp).first);
+			EXPECT((*mp).second, (*sp).second);
+			mp++;
+			sp++;
+		}
+	}
+
+	// One random operation on kv and the model, returns false when the
+	// store should be closed and reopened
+	bool model_step(KVStore &kv, std::map<uint64_t, std::string> &model,
+			std::mt19937_64 &rng)
+	{
+		uint64_t op = rng() % 100;
+		uint64_t key = rng() % MODEL_SPAN;
+		if (rng() % 50 == 0)
+			key = rng();
+
+		if (op < 55) {
+			std::string val(1 + rng() % 600, 'a' + rng() % 26);
+			kv.put(key, val);
+			model[key] = val;
+		} else if (op < 70) {
+			EXPECT(model.count(key) == 1, kv.del(key));
+			model.erase(key);
+		} else if (op < 75) {
+			kv.delete_blind(key);
+			model.erase(key);
+		} else if (op < 77) {
+			uint64_t begin = rng() % MODEL_SPAN;
+			uint64_t end = begin + (rng() % 20 == 0 ? rng() % (MODEL_SPAN / 4) : rng() % 200);
+			kv.delete_range(begin, end);
+			model.erase(model.lower_bound(begin), model.upper_bound(end));
+		} else if (op < 97) {
+			auto it = model.find(key);
+			EXPECT(it == model.end() ? not_found : it->second, kv.get(key));
+		} else if (op < 99) {
+			uint64_t begin = rng() % MODEL_SPAN;
+			uint64_t end = begin + rng() % 500;
+			std::list<std::pair<uint64_t, std::string> > list_stu;
+			kv.scan(begin, end, list_stu);
+			auto sp = list_stu.begin();
+			uint64_t count = 0;
+			for (auto mp = model.lower_bound(begin); mp != model.end() && (*mp).first <= end; ++mp, ++count) {
+				if (sp == list_stu.end())
+					continue;
+				EXPECT((*mp).first, (*sp).first);
+				EXPECT((*mp).second, (*sp).second);
+				sp++;
+			}
+			EXPECT(count, (uint64_t) list_stu.size());
+		} else {
+			return false;
+		}
+		return true;
+	}
+
+	// Random puts, deletes, range deletes, gets and scans checked against
+	// a std::map; the store is closed and reopened from its MANIFEST and
+	// WAL every hundred operations on average
+	void model_test(uint64_t ops, const Options &options, uint64_t seed)
+	{
+		uint64_t i = 0;
+		std::mt19937_64 rng(seed);
+		std::map<uint64_t, std::string> model;
+		std::string path = dir + "_model";
+
+		{
+			KVStore kv(path, options);
+			kv.reset();
+		}
+		while (i < ops) {
+			KVStore kv(path, options);
+			while (i < ops && model_step(kv, model, rng))
+				++i;
+			++i;
+			check_model(kv, model);
+		}
+
+		phase();
+
+		// Test recovery after the last reopen
+		KVStore kv(path, options);
+		for (auto &entry : model)
+			EXPECT(entry.second, kv.get(entry.first));
+		check_model(kv, model);
+		kv.reset();
+
+		phase();
+	}
+
+	// Number of keys in the bottom level of list, checking every level is sorted
+	uint64_t check_order(const SkipList &list)
+	{
+		uint64_t count = 0;
+		for (int level = MAX_LEVEL - 1; level >= 0; --level) {
+			count = 0;
+			for (SKNode *p = list.head->Next(level); p != list.NIL; p = p->Next(level), ++count)
+				if (p->Next(level) != list.NIL)
+					EXPECT(true, p->key < p->Next(level)->key);
+		}
+		return count;
+	}
+
+	// Writers racing on the same keys and on distinct keys of one skiplist,
+	// with a lock-free reader running alongside
+	void skiplist_test(int threads, uint64_t n)
+	{
+		int t;
+		std::vector<std::thread> workers;
+
+		// Test concurrent updates of shared keys: the value with the largest
+		// sequence number wins no matter which insert reaches the list last
+		{
+			SkipList list;
+			std::mutex mutex;
+			std::vector<std::pair<uint64_t, std::string> > last(SHARED_KEYS);
+			std::atomic<int> done(0);
+			std::atomic<uint64_t> missing(0);
+			for (t = 0; t < threads; ++t) {
+				workers.emplace_back([&, t]() {
+					for (uint64_t i = 0; i < n; ++i) {
+						uint64_t key = (i * 7 + t) % SHARED_KEYS;
+						std::string val = std::to_string(t) + ":" + std::to_string(i) + std::string(i % 50, 'x');
+						uint64_t seq;
+						{
+							std::lock_guard<std::mutex> lock(mutex);
+							seq = list.BeginWrite(1, 1, 12 + val.length());
+							last[key] = std::make_pair(seq, val);
+						}
+						list.Insert(key, val, TYPE_VALUE, seq);
+						list.Publish(seq);
+						list.EndWrite(1, 12 + val.length());
+					}
+					done++;
+				});
+			}
+			std::thread reader([&]() {
+				while (done < threads) {
+					for (uint64_t key = 0; key < SHARED_KEYS; ++key) {
+						std::string val;
+						ValueType type;
+						if (list.Search(key, val, type) && val.find(':') == std::string::npos)
+							missing++;
+					}
+				}
+			});
+			for (auto &worker : workers)
+				worker.join();
+			reader.join();
+			workers.clear();
+
+			EXPECT((uint64_t) 0, missing.load());
+			for (uint64_t key = 0; key < SHARED_KEYS; ++key) {
+				std::string val;
+				ValueType type;
+				EXPECT(true, list.Search(key, val, type));
+				EXPECT(last[key].second, val);
+			}
+			EXPECT((int) SHARED_KEYS, list.GetCount());
+			EXPECT(SHARED_KEYS, check_order(list));
+		}
+
+		phase();
+
+		// Test concurrent inserts of distinct keys
+		{
+			SkipList list;
+			std::atomic<int> done(0);
+			std::atomic<uint64_t> missing(0);
+			for (t = 0; t < threads; ++t) {
+				workers.emplace_back([&, t]() {
+					for (uint64_t i = 0; i < n; ++i)
+						list.Insert(i * threads + t, std::to_string(i * threads + t));
+					done++;
+				});
+			}
+			std::thread reader([&]() { // every key found already has its own value
+				uint64_t found = 0;
+				while (done < threads) {
+					std::string val;
+					ValueType type;
+					if (list.Search(found, val, type)) {
+						if (val != std::to_string(found))
+							missing++;
+						found++;
+					}
+				}
+			});
+			for (auto &worker : workers)
+				worker.join();
+			reader.join();
+			workers.clear();
+
+			EXPECT((uint64_t) 0, missing.load());
+			EXPECT((int) (n * threads), list.GetCount());
+			EXPECT(n * threads, check_order(list));
+			for (uint64_t key = 0; key < n * threads; ++key) {
+				std::string val;
+				ValueType type;
+				EXPECT(true, list.Search(key, val, type));
+				EXPECT(std::to_string(key), val);
+			}
+		}
+
+		phase();
+	}
+
+	// Value of the i-th write of a key, the number first so that readers can
+	// compare versions; the length is a function of the number
+	static std::string version_value(uint64_t i)
+	{
+		return std::to_string(i) + std::string(i % 100 * 4, 'v');
+	}
+
+	static bool valid_version(const std::string &val)
+	{
+		return val == version_value(strtoull(val.c_str(), nullptr, 10));
+	}
+
+	// Many get, scan and iterator threads running in parallel with writers,
+	// flushes and compactions on the same store
+	void concurrent_test(int threads, uint64_t n)
+	{
+		int t;
+		std::vector<std::thread> workers;
+		const uint64_t shared = threads * OWN_KEYS; // keys rewritten after range deletes
+
+		store.reset();
+		uint64_t compactions = store.GetCompactionStats().count;
+
+		// Test readers see every key move forward through whole versions
+		std::atomic<int> done(0);
+		std::atomic<uint64_t> bad(0);
+		for (t = 0; t < threads; ++t) {
+			workers.emplace_back([&, t]() {
+				for (uint64_t i = 0; i < n; ++i) {
+					uint64_t key = (i % OWN_KEYS) * threads + t;
+					store.put(key, version_value(i));
+					if (i % 97 == 0)
+						store.del(key);
+					if (i % 1000 == 0)
+						store.delete_range(shared + t * 10, shared + t * 10 + 5);
+					store.put(shared + t * 10 + 3, version_value(i));
+				}
+				done++;
+			});
+		}
+		for (int r = 0; r < 3; ++r) {
+			workers.emplace_back([&]() {
+				std::vector<uint64_t> seen(shared, 0);
+				while (done < threads) {
+					for (uint64_t key = 0; key < shared; key += 37) {
+						std::string val = store.get(key);
+						if (val.empty())
+							continue;
+						uint64_t v = strtoull(val.c_str(), nullptr, 10);
+						if (v < seen[key] || !valid_version(val))
+							bad++;
+						seen[key] = v;
+					}
+					std::list<std::pair<uint64_t, std::string> > list_stu;
+					store.scan(0, shared - 1, list_stu);
+					for (auto &entry : list_stu)
+						if (!valid_version(entry.second))
+							bad++;
+				}
+			});
+		}
+		workers.emplace_back([&]() { // long-lived iterators stay valid across flushes and compactions
+			while (done < threads) {
+				Iterator *iter = store.NewIterator(0, shared - 1);
+				uint64_t prev = 0, count = 0;
+				for ( ; iter->Valid(); iter->Next(), ++count) {
+					if ((count > 0 && iter->key() <= prev) || !valid_version(iter->value()))
+						bad++;
+					prev = iter->key();
+					if (count % 200 == 0)
+						std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				}
+				delete iter;
+			}
+		});
+		for (auto &worker : workers)
+			worker.join();
+		workers.clear();
+		EXPECT((uint64_t) 0, bad.load());
+
+		// The last write of each key, before and after flushing everything
+		for (int round = 0; round < 2; ++round) {
+			for (t = 0; t < threads; ++t) {
+				for (uint64_t k = 0; k < OWN_KEYS; ++k) {
+					uint64_t i = n - OWN_KEYS + k;
+					EXPECT(i % 97 == 0 ? not_found : version_value(i), store.get(k * threads + t));
+				}
+				EXPECT(version_value(n - 1), store.get(shared + t * 10 + 3));
+			}
+			store.Flush();
+		}
+		EXPECT(true, store.GetCompactionStats().count > compactions);
+
+		phase();
+
+		// Test an iterator pins its version: compactions that delete the
+		// files it reads do not change what it returns
+		for (uint64_t key = 0; key < PINNED_KEYS; ++key)
+			store.put(key, version_value(1));
+		store.Flush();
+		compactions = store.GetCompactionStats().count;
+		Iterator *iter = store.NewIterator(0, PINNED_KEYS - 1);
+		for (uint64_t i = 2; i < 6; ++i) {
+			for (uint64_t key = 0; key < PINNED_KEYS; ++key)
+				store.put(key, version_value(i));
+			store.Flush();
+		}
+		EXPECT(true, store.GetCompactionStats().count > compactions);
+		uint64_t count = 0;
+		for ( ; iter->Valid(); iter->Next(), ++count) {
+			EXPECT(count, iter->key());
+			EXPECT(version_value(1), iter->value());
+		}
+		EXPECT(PINNED_KEYS, count);
+		delete iter;
+		for (uint64_t key = 0; key < PINNED_KEYS; key += 97)
+			EXPECT(version_value(5), store.get(key));
+		store.reset();
+
+		phase();
+	}
+
+	// Open path in a child process, run writer(kv, t) in its threads and
+	// kill it with SIGKILL ms milliseconds after the store is open; the
+	// writers count their returned writes in acked, which is shared with
+	// the parent, and acked[threads] is set once the store is open
+	void kill_writers(const std::string &path, const Options &options,
+			  int threads, int ms, volatile uint64_t *acked,
+			  const std::function<void(KVStore &, int)> &writer)
+	{
+		for (int t = 0; t <= threads; ++t)
+			acked[t] = 0;
+		pid_t pid = fork();
+		if (pid == 0) {
+			KVStore kv(path, options);
+			acked[threads] = 1;
+			std::vector<std::thread> workers;
+			for (int t = 0; t < threads; ++t)
+				workers.emplace_back([&, t]() { writer(kv, t); });
+			for (auto &worker : workers)
+				worker.join();
+			_exit(0);
+		}
+		for (int wait = 0; wait < 30000 && acked[threads] == 0; ++wait)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+	}
+
+	// Writers going through the write queue are killed in the middle; every
+	// acknowledged write must be recovered from the WAL and SSTables
+	void crash_test(int threads, int rounds)
+	{
+		int t, r;
+		std::string path = dir + "_crash";
+		auto *acked = (volatile uint64_t *) mmap(nullptr, sizeof(uint64_t) * (threads + 1),
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		{
+			KVStore kv(path);
+			kv.reset();
+		}
+
+		// Test puts: each thread writes its keys in order, so what is
+		// recovered is a prefix that contains every acknowledged put
+		for (r = 0; r < rounds; ++r) {
+			Options options;
+			options.wal_sync = (WALSyncMode) (SYNC_EVERY_WRITE + r % 3);
+			kill_writers(path, options, threads, 300 + r * 200, acked, [&](KVStore &kv, int t) {
+				uint64_t base = (uint64_t) (r * 100 + t) * 10000000;
+				for (uint64_t i = 0; ; ++i) {
+					kv.put(base + i, version_value(i));
+					acked[t] = i + 1;
+				}
+			});
+
+			KVStore kv(path);
+			for (t = 0; t < threads; ++t) {
+				uint64_t base = (uint64_t) (r * 100 + t) * 10000000;
+				uint64_t i = 0;
+				std::string val;
+				while (!(val = kv.get(base + i)).empty()) {
+					EXPECT(version_value(i), val);
+					++i;
+				}
+				EXPECT(true, i >= acked[t]);
+				for (uint64_t j = i; j < i + 50; ++j)
+					EXPECT(not_found, kv.get(base + j));
+			}
+		}
+
+		phase();
+
+		// Test batches: each thread rewrites its keys in one batch, every
+		// fourth one after a range delete; a batch is recovered whole or not
+		// at all, and never older than the last acknowledged one
+		for (r = 0; r < rounds; ++r) {
+			Options options;
+			options.wal_sync = r % 2 ? SYNC_EVERY_WRITE : SYNC_PERIODIC;
+			kill_writers(path, options, threads, 400 + r * 300, acked, [&](KVStore &kv, int t) {
+				uint64_t base = (uint64_t) (r * 100 + t) * 1000;
+				for (uint64_t i = 1; ; ++i) {
+					WriteBatch batch;
+					if (i % 4 == 0)
+						batch.DeleteRange(base, base + BATCH_KEYS - 1);
+					for (uint64_t k = 0; k < BATCH_KEYS; ++k)
+						batch.Put(base + k, version_value(i));
+					kv.write(batch);
+					acked[t] = i;
+				}
+			});
+
+			KVStore kv(path);
+			for (t = 0; t < threads; ++t) {
+				uint64_t base = (uint64_t) (r * 100 + t) * 1000;
+				std::string first = kv.get(base);
+				EXPECT(true, first.empty() ? acked[t] == 0 : valid_version(first));
+				for (uint64_t k = 1; k < BATCH_KEYS; ++k)
+					EXPECT(first, kv.get(base + k));
+				EXPECT(true, strtoull(first.c_str(), nullptr, 10) >= acked[t]);
+			}
+		}
+
+		phase();
+
+		{
+			KVStore kv(path);
+			kv.reset();
+		}
+		munmap((void *) acked, sizeof(uint64_t) * (threads + 1));
+	}
+
+public:
+	StressTest(const std::string &dir, bool v=true) : Test(dir, v), dir(dir)
+	{
+	}
+
+	void start_test(void *args = NULL) override
+	{
+		std::cout << "KVStore Stress Test" << std::endl;
+
+		std::cout << "[Model Test]" << std::endl;
+		Options options;
+		options.max_open_files = 3;
+		model_test(MODEL_OPS, options, 1);
+		options.block_size = 0;
+		options.compression = NO_COMPRESSION;
+		options.use_mmap = false;
+		options.row_cache_size = 64 * 1024;
+		model_test(MODEL_OPS, options, 2);
+		report();
+
+		std::cout << "[Concurrent SkipList Test]" << std::endl;
+		skiplist_test(THREADS, SKIPLIST_OPS);
+		report();
+
+		std::cout << "[Concurrent KVStore Test]" << std::endl;
+		concurrent_test(THREADS, STORE_OPS);
+		report();
+
+		std::cout << "[Crash Recovery Test]" << std::endl;
+		crash_test(THREADS, CRASH_ROUNDS);
+		report();
+	}
+};
+
+int main(int argc, char *argv[])
+{
+	bool verbose = (argc == 2 && std::string(argv[1]) == "-v");
+
+	std::cout << "Usage: " << argv[0] << " [-v]" << std::endl;
+	std::cout << "  -v: print extra info for failed tests [currently ";
+	std::cout << (verbose ? "ON" : "OFF")<< "]" << std::endl;
+	std::cout << std::endl;
+	std::cout.flush();
+
+	StressTest test("./stress_data", verbose);
+
+	test.start_test();
+
+	return 0;
+}
@@ -0,0 +1,134 @@
+#include "table_cache.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TableFile::~TableFile()
+{
+    if (map != nullptr)
+        munmap(map, size);
+    if (fd >= 0)
+        ::close(fd);
+}
+
+// 函数参数 use_mmap: 是否尝试整体映射文件
+// 函数返回值 shared_ptr<TableFile>: 文件不存在时为空
+// 函数功能：打开文件并确定长度；映射成功后文件描述符不再需要，立即关闭，缓存的文件不会占用描述符
+std::shared_ptr<TableFile> TableFile::Open(const std::string &path, bool use_mmap)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return nullptr;
+    }
+
+    std::shared_ptr<TableFile> file(new TableFile);
+    file->fd = fd;
+    file->size = st.st_size;
+    if (use_mmap && file->size > 0) {
+        void *addr = mmap(nullptr, file->size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            file->map = (char *) addr;
+            ::close(fd);
+            file->fd = -1;
+        }
+    }
+    return file;
+}
+
+// 函数功能：将 [offset, offset + n) 复制到 dst，超出文件长度时返回 false；映射的文件只需 memcpy，否则一次 pread
+bool TableFile::Read(uint64_t offset, uint64_t n, char *dst) const
+{
+    if (offset > size || n > size - offset)
+        return false;
+    if (map != nullptr) {
+        memcpy(dst, map + offset, n);
+        return true;
+    }
+    for (uint64_t done = 0; done < n; ) {
+        ssize_t ret = pread(fd, dst + done, n - done, offset + done);
+        if (ret <= 0)
+            return false;
+        done += ret;
+    }
+    return true;
+}
+
+// 函数参数 scratch: 未映射时存放读入的内容
+// 函数返回值 const char* : 指向 [offset, offset + n) 的内容，映射的文件直接指向映射区，读取失败时为 nullptr
+const char *TableFile::Read(uint64_t offset, uint64_t n, std::string &scratch) const
+{
+    if (offset > size || n > size - offset)
+        return nullptr;
+    if (map != nullptr)
+        return map + offset;
+    scratch.resize(n);
+    return Read(offset, n, &scratch[0]) ? scratch.c_str() : nullptr;
+}
+
+// 函数功能：返回 path 对应的打开文件，命中时移到最前；打开文件不持有锁，并发打开同一文件时只保留先放入的一个
+std::shared_ptr<TableFile> TableCache::Open(const std::string &path)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = table.find(path);
+        if (it != table.end()) {
+            hits ++ ;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+        misses ++ ;
+    }
+
+    std::shared_ptr<TableFile> file = TableFile::Open(path, use_mmap);
+    if (!file || capacity == 0)
+        return file;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = table.find(path);
+    if (it != table.end())
+        return it->second->second;
+    lru.emplace_front(path, file);
+    table[path] = lru.begin();
+    while (lru.size() > capacity) {
+        table.erase(lru.back().first);
+        lru.pop_back();
+    }
+    return file;
+}
+
+// 函数功能：文件被删除之前从缓存中移除，正在使用它的读者不受影响
+void TableCache::Evict(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = table.find(path);
+    if (it == table.end())
+        return;
+    lru.erase(it->second);
+    table.erase(it);
+}
+
+void TableCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    lru.clear();
+    table.clear();
+}
+
+uint64_t TableCache::Hits()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+uint64_t TableCache::Misses()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// 一个打开的 sst 文件：优先整体 mmap（之后的读取不需要系统调用），映射失败或关闭 mmap 时保留文件描述符用 pread 读取
+// 文件写完之后不再修改，长度在打开时由 fstat 一次确定
+class TableFile {
+private:
+    int fd; // 已经映射时为 -1
+    uint64_t size;
+    char *map;
+
+    TableFile(): fd(-1), size(0), map(nullptr) {}
+
+public:
+    ~TableFile();
+
+    static std::shared_ptr<TableFile> Open(const std::string &path, bool use_mmap);
+
+    uint64_t Size() const {return size;}
+    bool Mapped() const {return map != nullptr;}
+    bool Read(uint64_t offset, uint64_t n, char *dst) const;
+    const char *Read(uint64_t offset, uint64_t n, std::string &scratch) const;
+};
+
+// 按路径缓存打开的 sst 文件，超过 capacity 时关闭最久未使用的文件
+// 返回的 shared_ptr 在文件被淘汰或删除之后仍然可用，最后一个使用者释放时才真正关闭
+class TableCache {
+private:
+    typedef std::pair<std::string, std::shared_ptr<TableFile> > Entry;
+
+    std::mutex mutex;
+    uint64_t capacity;
+    bool use_mmap;
+    std::list<Entry> lru; // 最近使用的在前
+    std::unordered_map<std::string, std::list<Entry>::iterator> table;
+    uint64_t hits;
+    uint64_t misses;
+
+public:
+    TableCache(uint64_t capacity, bool use_mmap): capacity(capacity), use_mmap(use_mmap), hits(0), misses(0) {}
+
+    std::shared_ptr<TableFile> Open(const std::string &path);
+    void Evict(const std::string &path);
+    void Clear();
+    uint64_t Hits();
+    uint64_t Misses();
+};
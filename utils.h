@@ -1,9 +1,11 @@
 #pragma once
 
+#include <cstdint>
 #include <sstream>
 #include <sys/stat.h>
 #include <vector>
 #include <sys/types.h>
+#include <fcntl.h>
 
 #ifdef _WIN32
 #include <direct.h>
@@ -137,4 +139,58 @@ namespace utils{
             return ::unlink(path);
         #endif
     }
+
+    /**
+     * Flush the data of an opened file to disk
+     * @param fd file descriptor to be synced.
+     * @return 0 if sync successfully, -1 otherwise.
+     */
+    static inline int fsync(int fd){
+        #ifdef _WIN32
+            return ::_commit(fd);
+        #else
+            return ::fsync(fd);
+        #endif
+    }
+
+    /**
+     * Flush the data of a file to disk
+     * @param path file to be synced.
+     * @return 0 if sync successfully, -1 otherwise.
+     */
+    static inline int syncFile(const char *path){
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0){
+            return -1;
+        }
+        int ret = fsync(fd);
+        ::close(fd);
+        return ret;
+    }
+
+    /**
+     * Standard CRC32 (IEEE 802.3), used to detect records torn by a crash
+     * @param data bytes to be checked.
+     * @param n number of bytes.
+     * @return the checksum.
+     */
+    static inline uint32_t crc32(const char *data, size_t n){
+        struct Table {
+            uint32_t entry[256];
+            Table(){
+                for (uint32_t i = 0; i < 256; ++i) {
+                    uint32_t c = i;
+                    for (int j = 0; j < 8; ++j)
+                        c = (c & 1) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+                    entry[i] = c;
+                }
+            }
+        };
+        static const Table table; // thread-safe initialization
+
+        uint32_t crc = 0xFFFFFFFFU;
+        for (size_t i = 0; i < n; ++i)
+            crc = table.entry[(crc ^ (uint8_t) data[i]) & 0xFF] ^ (crc >> 8);
+        return crc ^ 0xFFFFFFFFU;
+    }
 }
@@ -0,0 +1,85 @@
+#include "version.h"
+#include <algorithm>
+
+Version::Version(const Version &other): levels(other.levels)
+{
+    for (auto &files : levels) {
+        for (auto ptr : files)
+            ptr->Ref();
+    }
+}
+
+Version::~Version()
+{
+    Clear();
+}
+
+const std::vector<sst_buf *> &Version::Files(int level) const
+{
+    static const std::vector<sst_buf *> empty;
+    if (level < 0 || level > MaxLevel())
+        return empty;
+    return levels[level];
+}
+
+uint64_t Version::NumFiles() const
+{
+    uint64_t total = 0;
+    for (auto &files : levels)
+        total += files.size();
+    return total;
+}
+
+// 函数参数 add: 新文件对应的缓冲区结构体，其 level 已经确定
+// 函数功能：按照所在层的顺序插入，level0 新文件在前，其余各层按最小键值升序
+void Version::Add(sst_buf *add)
+{
+    if (add->level > MaxLevel())
+        levels.resize(add->level + 1);
+
+    std::vector<sst_buf *> &files = levels[add->level];
+    std::vector<sst_buf *>::iterator pos;
+    if (add->level == 0) {
+        pos = std::upper_bound(files.begin(), files.end(), add, [](const sst_buf *a, const sst_buf *b) {
+            return a->time > b->time;
+        });
+    } else {
+        pos = std::upper_bound(files.begin(), files.end(), add, [](const sst_buf *a, const sst_buf *b) {
+            return a->min < b->min;
+        });
+    }
+    files.insert(pos, add);
+    add->Ref();
+}
+
+// 函数功能：将目标结构体从所在层中取下并释放本版本的引用
+void Version::Remove(sst_buf *del)
+{
+    std::vector<sst_buf *> &files = levels[del->level];
+    files.erase(std::find(files.begin(), files.end(), del));
+    del->Unref();
+}
+
+// 函数参数 level: 不小于 1 的层号
+// 函数返回值 sst_buf* : 键值区间包含 key 的唯一文件，不存在时返回 nullptr
+// 函数功能：各文件互不重叠，最大键值同样有序，二分查找第一个最大键值不小于 key 的文件
+sst_buf *Version::FindFile(int level, uint64_t key) const
+{
+    const std::vector<sst_buf *> &files = Files(level);
+    auto pos = std::lower_bound(files.begin(), files.end(), key, [](const sst_buf *a, uint64_t target) {
+        return a->max < target;
+    });
+    if (pos == files.end() || (*pos)->min > key)
+        return nullptr;
+    return *pos;
+}
+
+// 函数功能：释放对全部缓冲区结构体的引用
+void Version::Clear()
+{
+    for (auto &files : levels) {
+        for (auto ptr : files)
+            ptr->Unref();
+    }
+    levels.clear();
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "sstable.h"
+
+// 磁盘上全部 SSTable 的分层视图，对其中的每个缓冲区结构体持有一个引用
+// level0 的文件键值区间可能重叠，按时间戳从新到旧排列；level1 及以下每层的文件键值区间互不重叠，按键值从小到大排列
+// 查找一个键时每层至多访问一个文件（level0 除外），并且越靠前的文件越新，找到即可返回
+// 安装之后的 Version 不再修改：落盘与 compaction 复制当前版本、修改副本后整体替换，读者固定某个版本后不需要任何锁
+class Version {
+private:
+    std::vector<std::vector<sst_buf *> > levels;
+
+public:
+    Version() = default;
+    Version(const Version &other);
+    Version &operator=(const Version &) = delete;
+    ~Version();
+
+    int MaxLevel() const {return (int) levels.size() - 1;}
+    const std::vector<sst_buf *> &Files(int level) const;
+    uint64_t NumFiles() const;
+
+    void Add(sst_buf *add);
+    void Remove(sst_buf *del);
+    sst_buf *FindFile(int level, uint64_t key) const;
+    void Clear();
+};
@@ -0,0 +1,229 @@
+#include "wal.h"
+#include "utils.h"
+#include <fstream>
+#include <chrono>
+#include <cerrno>
+
+WriteAheadLog::WriteAheadLog(const std::string &path, WALSyncMode mode, uint64_t interval)
+    : path(path), mode(mode), interval(interval), appended(0), synced(0), syncing(false), dirty(false), failed(false), failed_seq(0), stop(false)
+{
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    failed = fd < 0;
+
+    if (mode == SYNC_PERIODIC)
+        syncer = std::thread(&WriteAheadLog::PeriodicSync, this);
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_all();
+    if (syncer.joinable())
+        syncer.join();
+
+    utils::fsync(fd);
+    ::close(fd);
+}
+
+// 函数返回值 bool: 全部写入时返回 true，被信号打断时继续写入剩余部分
+bool WriteAheadLog::WriteAll(const std::string &data)
+{
+    size_t done = 0;
+    while (done < data.length()) {
+        ssize_t n = ::write(fd, data.c_str() + done, data.length() - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        done += n;
+    }
+    return true;
+}
+
+// 函数返回值 string: 完整的一条记录，校验和(4) + 长度(4) + 键(8) + 类型(1) + 值
+std::string WriteAheadLog::Encode(uint64_t key, ValueType type, const std::string &val)
+{
+    uint32_t len = sizeof(uint64_t) + 1 + val.length();
+    std::string record(8 + len, '\0');
+    memcpy(&record[8], &key, sizeof(uint64_t));
+    record[16] = (char) type;
+    memcpy(&record[17], val.c_str(), val.length());
+    uint32_t crc = utils::crc32(&record[8], len);
+    uint32_t tagged = len | WAL_TYPED_RECORD;
+    memcpy(&record[0], &crc, sizeof(uint32_t));
+    memcpy(&record[4], &tagged, sizeof(uint32_t));
+    return record;
+}
+
+bool WriteAheadLog::Append(uint64_t key, const std::string &val, ValueType type)
+{
+    return Commit(Encode(key, type, val));
+}
+
+bool WriteAheadLog::AppendBatch(const std::vector<const LogRecord *> &records)
+{
+    if (records.size() == 1)
+        return Commit(Encode(records[0]->key, records[0]->type, records[0]->val));
+
+    std::string batch;
+    for (auto record : records) {
+        uint32_t len = record->val.length();
+        batch.append((const char *) &record->key, sizeof(uint64_t));
+        batch.push_back((char) record->type);
+        batch.append((const char *) &len, sizeof(uint32_t));
+        batch.append(record->val);
+    }
+    return Commit(Encode(records.size(), TYPE_BATCH, batch));
+}
+
+// 函数返回值 bool: 记录按策略持久化时返回 true；此前已经失败过，或者本次写入、fsync 失败时返回 false
+// 函数功能：按刷盘策略写入一条已经编码的记录
+bool WriteAheadLog::Commit(const std::string &record)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (failed)
+        return false;
+
+    if (mode == SYNC_EVERY_WRITE) {
+        if (!WriteAll(record) || utils::fsync(fd) != 0)
+            failed = true;
+        return !failed;
+    }
+
+    if (mode == SYNC_PERIODIC) {
+        if (!WriteAll(record)) // 进入操作系统缓存后即可承受进程被杀死
+            failed = true;
+        dirty = true;
+        return !failed;
+    }
+
+    // SYNC_GROUP_COMMIT: 第一个等待的写者负责把目前积累的所有记录一次写入并 fsync，失败时同一组的写者都返回 false
+    pending.append(record);
+    uint64_t seq = ++appended;
+    while (synced < seq) {
+        if (!syncing) {
+            syncing = true;
+            std::string batch;
+            batch.swap(pending);
+            uint64_t target = appended;
+
+            lock.unlock();
+            bool ok = WriteAll(batch) && utils::fsync(fd) == 0;
+            lock.lock();
+
+            if (!ok && !failed) {
+                failed = true;
+                failed_seq = synced + 1;
+            }
+            synced = target;
+            syncing = false;
+            cv.notify_all();
+        } else {
+            cv.wait(lock);
+        }
+    }
+    return !failed || seq < failed_seq;
+}
+
+void WriteAheadLog::PeriodicSync()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stop) {
+        cv.wait_for(lock, std::chrono::milliseconds(interval));
+        if (!dirty)
+            continue;
+        dirty = false;
+        lock.unlock();
+        bool ok = utils::fsync(fd) == 0;
+        lock.lock();
+        if (!ok)
+            failed = true;
+    }
+}
+
+void WriteAheadLog::Truncate()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (syncing)
+        cv.wait(lock);
+
+    if (::ftruncate(fd, 0) == 0)
+        utils::fsync(fd);
+    dirty = false;
+}
+
+// 函数参数 payload: TYPE_BATCH 记录校验和之后的内容；count: 记录条数
+// 函数返回值 bool: 整组是否完好，完好时才将全部记录追加到 records
+static bool DecodeBatch(const std::string &payload, uint64_t count, std::vector<LogRecord> &records)
+{
+    std::vector<LogRecord> batch;
+    size_t pos = sizeof(uint64_t) + 1;
+    for (uint64_t i = 0; i < count; ++i) {
+        uint64_t key;
+        uint32_t len;
+        if (pos + sizeof(uint64_t) + 1 + sizeof(uint32_t) > payload.length())
+            return false;
+        memcpy(&key, payload.c_str() + pos, sizeof(uint64_t));
+        auto type = (ValueType) (uint8_t) payload[pos + sizeof(uint64_t)];
+        memcpy(&len, payload.c_str() + pos + sizeof(uint64_t) + 1, sizeof(uint32_t));
+        pos += sizeof(uint64_t) + 1 + sizeof(uint32_t);
+        if (len > payload.length() - pos)
+            return false;
+        if (type != TYPE_VALUE && type != TYPE_DELETION && type != TYPE_RANGE_DELETION)
+            return false;
+        if (type == TYPE_RANGE_DELETION && len != sizeof(uint64_t))
+            return false;
+        batch.emplace_back(key, type, payload.substr(pos, len));
+        pos += len;
+    }
+    if (pos != payload.length())
+        return false;
+
+    for (auto &record : batch)
+        records.push_back(std::move(record));
+    return true;
+}
+
+// 旧版本写出的记录没有类型字节，value 为 "~DELETED~" 时按删除处理
+void WriteAheadLog::ReadAll(const std::string &path, std::vector<LogRecord> &records)
+{
+    std::ifstream in(path, std::ios::binary|std::ios::in);
+    if (!in)
+        return;
+
+    while (true) {
+        uint32_t crc, len;
+        if (!in.read((char*)&crc, sizeof(uint32_t)) || !in.read((char*)&len, sizeof(uint32_t)))
+            break;
+        bool typed = len & WAL_TYPED_RECORD;
+        len &= ~WAL_TYPED_RECORD;
+        if (len < sizeof(uint64_t) + typed || len > (1U << 30)) // 长度字段本身已经损坏
+            break;
+
+        std::string payload(len, '\0');
+        if (!in.read(&payload[0], len) || utils::crc32(payload.c_str(), len) != crc)
+            break;
+
+        uint64_t key;
+        memcpy(&key, payload.c_str(), sizeof(uint64_t));
+        if (typed) {
+            auto type = (ValueType) (uint8_t) payload[sizeof(uint64_t)];
+            if (type == TYPE_BATCH) {
+                if (!DecodeBatch(payload, key, records))
+                    break;
+                continue;
+            }
+            if (type != TYPE_VALUE && type != TYPE_DELETION && type != TYPE_RANGE_DELETION)
+                break;
+            if (type == TYPE_RANGE_DELETION && len != 2 * sizeof(uint64_t) + 1)
+                break;
+            records.emplace_back(key, type, payload.substr(sizeof(uint64_t) + 1));
+        } else {
+            std::string val = payload.substr(sizeof(uint64_t));
+            records.emplace_back(key, val == LEGACY_DELETED_VALUE ? TYPE_DELETION : TYPE_VALUE, val == LEGACY_DELETED_VALUE ? "" : val);
+        }
+    }
+}
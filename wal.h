@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "options.h"
+
+#define WAL_TYPED_RECORD 0x80000000U // 长度字段的最高位：键之后有一个类型字节，旧版本的记录没有
+
+// 日志中的一条记录
+struct LogRecord {
+    uint64_t key;
+    ValueType type;
+    std::string val;
+
+    LogRecord(uint64_t key, ValueType type, std::string val): key(key), type(type), val(std::move(val)) {}
+};
+
+// 跳表的预写日志：每条记录为 校验和(4) + 长度(4) + 键(8) + 类型(1) + 值，校验和覆盖长度之后的全部内容
+// 范围删除的记录以区间起点为键，值为 8 字节的区间终点
+// TYPE_BATCH 记录的值为各条记录的 键(8) + 类型(1) + 值的长度(4) + 值，整组共用一个校验和，回放时要么全部恢复要么全部丢弃
+// 进程崩溃后重新打开时按顺序回放，跳表成功写为 SSTable 后清空
+class WriteAheadLog {
+private:
+    std::string path;
+    int fd;
+    WALSyncMode mode;
+    uint64_t interval;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::string pending; // 尚未写入文件的记录（GROUP_COMMIT）
+    uint64_t appended; // 已经追加的记录序号
+    uint64_t synced; // 已经持久化的记录序号
+    bool syncing; // 是否已有写者在为整组记录 fsync
+    bool dirty; // 上次 fsync 之后是否有新的写入（PERIODIC）
+    bool failed; // 写入或 fsync 失败之后为 true：文件末尾可能是残缺的记录，回放到此为止，之后追加的记录不能再报告成功
+    uint64_t failed_seq; // 第一条没有成功持久化的记录序号（GROUP_COMMIT），此前各组的写者仍然成功
+
+    bool stop;
+    std::thread syncer; // PERIODIC 模式下的后台刷盘线程
+
+    bool WriteAll(const std::string &data);
+    void PeriodicSync();
+    bool Commit(const std::string &record);
+    static std::string Encode(uint64_t key, ValueType type, const std::string &val);
+
+public:
+    WriteAheadLog(const std::string &path, WALSyncMode mode, uint64_t interval);
+    ~WriteAheadLog();
+
+    // 按刷盘策略追加一条记录，返回 true 时该记录已经满足策略所要求的持久性，写入或 fsync 失败时返回 false，可以被多个写者并发调用
+    bool Append(uint64_t key, const std::string &val, ValueType type = TYPE_VALUE);
+
+    // 将一组记录作为一条 TYPE_BATCH 记录追加并按策略刷盘，只有一条时按普通记录追加，返回值同 Append
+    bool AppendBatch(const std::vector<const LogRecord *> &records);
+
+    // 对应的跳表已经落盘，清空日志
+    void Truncate();
+
+    // 读出日志中所有完整的记录，遇到残缺或校验失败的记录即停止
+    static void ReadAll(const std::string &path, std::vector<LogRecord> &records);
+};
@@ -0,0 +1,36 @@
+#include "write_batch.h"
+
+WriteBatch::WriteBatch(): entries(0), bytes(0)
+{
+}
+
+void WriteBatch::Put(uint64_t key, const std::string &s)
+{
+    records.emplace_back(key, TYPE_VALUE, s);
+    entries ++ ;
+    bytes += 12 + (int) s.length();
+}
+
+// 函数功能：写入 key 的删除标记，不检查 key 是否存在
+void WriteBatch::Delete(uint64_t key)
+{
+    records.emplace_back(key, TYPE_DELETION, "");
+    entries ++ ;
+    bytes += 12;
+}
+
+// 函数功能：删除 [begin, end] 中此前写入的全部键值对，包括同一批中先加入的记录；begin > end 时忽略
+void WriteBatch::DeleteRange(uint64_t begin, uint64_t end)
+{
+    if (begin > end)
+        return;
+    records.emplace_back(begin, TYPE_RANGE_DELETION, std::string((const char*)&end, sizeof(uint64_t)));
+    bytes += 4 + 2 * 16; // 至多增加两段
+}
+
+void WriteBatch::Clear()
+{
+    records.clear();
+    entries = 0;
+    bytes = 0;
+}
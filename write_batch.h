@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "wal.h"
+
+// 一组写入：依次收集 put、删除与范围删除，经由 KVStore::write 原子地写入
+// 整批在 WAL 中是一条记录，崩溃后要么全部恢复要么全部丢弃；读者要么看到整批的结果，要么一条也看不到
+// 同一批中后加入的记录覆盖先加入的记录
+class WriteBatch {
+private:
+    std::vector<LogRecord> records;
+    int entries; // 键值对的个数，不含范围删除
+    int bytes; // 写入跳表后增加的 sst 文件长度
+
+public:
+    WriteBatch();
+
+    void Put(uint64_t key, const std::string &s);
+    void Delete(uint64_t key);
+    void DeleteRange(uint64_t begin, uint64_t end);
+    void Clear();
+
+    const std::vector<LogRecord> &Records() const {return records;}
+    bool Empty() const {return records.empty();}
+    int Count() const {return (int) records.size();}
+    int Entries() const {return entries;}
+    int Bytes() const {return bytes;}
+};